@@ -0,0 +1,53 @@
+//---------------------------< /-/ AMSL /-/ >------------------------------
+/**
+ * file         :       adaptive_rate.h
+ *
+ *
+ * Environment  :       g++
+ *
+ */
+//-----------------------------------------------------------------------------
+
+#ifndef _ADAPTIVE_RATE_H
+#define _ADAPTIVE_RATE_H
+
+const float OI_UPDATE_PERIOD=0.015; // sec, the OI refreshes its sensor data at this period
+
+// Loop rate that starts from the highest rate the link can carry and
+// follows the measured cycle time, staying just above the work done in a
+// cycle so that cycles do not overrun.
+class AdaptiveRate {
+public:
+	// period in sec of one request/response cycle:
+	// bytes on the wire (10 bits each at bps), the waits of getSensors,
+	// but never faster than the OI refreshes its data
+	static double minPeriod(int bps, int request_bytes, int response_bytes, double wait);
+
+	// min_period from minPeriod(), max_period bounds the slow down
+	AdaptiveRate(double min_period, double max_period=0.5);
+
+	// sleeps until the end of the current cycle and starts the next one
+	void sleep();
+
+	double period() const { return period_; }
+	double rate() const { return 1.0/period_; }
+	// cycles whose work took longer than the period
+	unsigned long overruns() const { return overruns_; }
+	unsigned long cycles() const { return cycles_; }
+	// smoothed work time of a cycle in sec
+	double workTime() const { return work_; }
+
+protected:
+	double min_period_;
+	double max_period_;
+	double period_;
+
+	double cycle_start_;
+	double work_;
+	int calm_cycles_;
+
+	unsigned long overruns_;
+	unsigned long cycles_;
+};	// class
+
+#endif	// _ADAPTIVE_RATE_H
@@ -0,0 +1,66 @@
+//---------------------------< /-/ AMSL /-/ >------------------------------
+/**
+ * file         :       bulk_decoder.h
+ *
+ *
+ * Environment  :       g++
+ *
+ */
+//-----------------------------------------------------------------------------
+
+#ifndef _BULK_DECODER_H
+#define _BULK_DECODER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+// Decodes long captures of ALL_PACKET replies into one contiguous array
+// per field (structure of arrays) instead of one Roomba500State per frame.
+// Does not depend on ROS.
+class BulkDecoder {
+public:
+	enum TYPE {
+		T_U8=1,
+		T_U16=2,
+		T_S16=3,
+		T_S32=4,
+		T_F64=5
+	};
+
+	struct Column {
+		std::string name;
+		TYPE type;
+		std::vector<unsigned char> bytes;
+
+		size_t elementSize() const;
+		template<class T> T* as(){ return reinterpret_cast<T*>(&bytes[0]); }
+		template<class T> const T* as() const { return reinterpret_cast<const T*>(&bytes[0]); }
+	};
+
+	struct Columns {
+		size_t frames;
+		std::vector<Column> columns;
+
+		Column* find(const std::string& name);
+		Column& add(const std::string& name, TYPE type);
+	};
+
+	// data holds frames back to back, ALL_PACKET_SIZE bytes each
+	static void decode(const unsigned char* data, size_t frames, Columns& out);
+
+	// adds d_encoder_left/right: wrap-around corrected tick deltas
+	static void unwrapEncoders(Columns& cols);
+	// adds x, y, theta integrated from the deltas like the driver does.
+	// needs unwrapEncoders() first
+	static void integrateOdometry(Columns& cols);
+
+	// "ROICOL01", uint64 frames, uint32 columns, then per column
+	// char name[32], uint32 type, uint64 data offset, followed by the data
+	// of every column in order. values are in host byte order.
+	static bool write(const Columns& cols, const char* path);
+};	// class
+
+#endif	// _BULK_DECODER_H
@@ -0,0 +1,89 @@
+//---------------------------< /-/ AMSL /-/ >------------------------------
+/**
+ * file         :       command_arbiter.h
+ *
+ *
+ * Environment  :       g++
+ *
+ */
+//-----------------------------------------------------------------------------
+
+#ifndef _COMMAND_ARBITER_H
+#define _COMMAND_ARBITER_H
+
+#include "ros/ros.h"
+#include <roomba_500driver_meiji/RoombaCtrl.h>
+#include <geometry_msgs/Twist.h>
+
+#include <boost/function.hpp>
+#include <string>
+#include <vector>
+
+// expiry of a configured source without a positive timeout [sec]
+const double COMMAND_DEFAULT_TIMEOUT=0.5;
+
+// Chooses between several command sources by priority.
+// Sources are read from "~sources" (list of names) and
+// "~source/<name>/{topic,type,priority,timeout,queue}".
+// Drive commands only keep the latest one per source and are executed in
+// update(), so a higher priority command does not wait behind queued lower
+// priority ones. Other commands are executed when they arrive. When the
+// source in control times out after a drive command, stop is called
+// instead of execute, so whatever the command started is not cancelled.
+class CommandArbiter {
+public:
+	typedef boost::function<void(const roomba_500driver_meiji::RoombaCtrl&)> Executor;
+	typedef boost::function<void()> Stopper;
+
+	CommandArbiter(ros::NodeHandle& n, ros::NodeHandle& pn, Executor execute, Stopper stop,
+		const ros::TransportHints& hints=ros::TransportHints());
+
+	// call once per cycle after ros::spinOnce()
+	void update();
+
+	// name of the source in control, empty when none
+	std::string active() const;
+
+protected:
+	enum SOURCE_TYPE {
+		ST_CONTROL=0,	// RoombaCtrl
+		ST_TWIST		// geometry_msgs/Twist, executed as DRIVE_DIRECT
+	};
+
+	struct Source {
+		std::string name;
+		std::string topic;
+		SOURCE_TYPE type;
+		int priority;
+		double timeout;		// sec, 0 never expires (only the unconfigured defaults)
+		int queue;
+		double last;		// monotonic time of the last command
+		bool pending;		// drive command not executed yet
+		bool driving;		// the last command was a drive command
+		roomba_500driver_meiji::RoombaCtrl cmd;
+		ros::Subscriber sub;
+	};
+
+	void addSource(const std::string& name, const std::string& topic, SOURCE_TYPE type,
+		int priority, double timeout, int queue);
+	void subscribe(ros::NodeHandle& n, int index, const ros::TransportHints& hints);
+
+	void controlCallback(const roomba_500driver_meiji::RoombaCtrlConstPtr& msg, int index);
+	void twistCallback(const geometry_msgs::TwistConstPtr& msg, int index);
+	void submit(int index, const roomba_500driver_meiji::RoombaCtrl& cmd);
+
+	bool accept(int index, double now);
+	bool expired(int index, double now) const;
+	void setActive(int index);
+	void flush();
+
+	static bool isDrive(int mode);
+
+	Executor execute_;
+	Stopper stop_;
+	std::vector<Source> sources_;
+	int active_;
+	ros::Publisher pub_active_;
+};	// class
+
+#endif	// _COMMAND_ARBITER_H
@@ -0,0 +1,92 @@
+//---------------------------< /-/ AMSL /-/ >------------------------------
+/**
+ * file         :       coverage_grid.h
+ *
+ *
+ * Environment  :       g++
+ *
+ */
+//-----------------------------------------------------------------------------
+
+#ifndef _COVERAGE_GRID_H
+#define _COVERAGE_GRID_H
+
+#include "ros/ros.h"
+#include <nav_msgs/GetMap.h>
+#include <nav_msgs/OccupancyGrid.h>
+
+#include <stdint.h>
+#include <map>
+#include <set>
+
+const int COVERAGE_TILE=64;			// cells per tile side, one uint64_t per tile row
+const int COVERAGE_GROW=4;			// tiles added around the extent when it grows, at least
+const float COVERAGE_MAX_STEP=0.5;	// m, longer odometry steps are not swept
+
+// Floor area swept by the robot, in the odom frame.
+// Cells are bits of 64x64 tiles that are only allocated when touched.
+// Changed tiles go out as map_msgs/OccupancyGridUpdate on
+// /roomba/coverage_updates, the whole grid on /roomba/coverage when its
+// extent grows and from the /roomba/get_coverage service. The extent at
+// least doubles on each side it grows and the whole grid is sent at most
+// once per ~coverage_grid_period, so the grids stay few as the area grows;
+// tiles inside the last sent extent keep going out as updates meanwhile.
+class CoverageGrid {
+public:
+	CoverageGrid(ros::NodeHandle& n, ros::NodeHandle& pn);
+
+	// robot position, sweeps the footprint from the previous one
+	void update(double x, double y, const ros::Time& stamp);
+
+	// covered cells and allocated tiles, for diagnostics
+	unsigned long coveredCells() const;
+	size_t tiles() const { return tiles_.size(); }
+
+protected:
+	struct Tile {
+		uint64_t rows[COVERAGE_TILE];
+	};
+	typedef std::map<uint64_t, Tile> TileMap;
+
+	static uint64_t key(int tx, int ty){ return ((uint64_t)(uint32_t)tx<<32)|(uint32_t)ty; }
+	static int keyX(uint64_t k){ return (int)(uint32_t)(k>>32); }
+	static int keyY(uint64_t k){ return (int)(uint32_t)k; }
+	// floor division, also for negative cells
+	static int tileOf(int cell){ return cell>=0 ? cell/COVERAGE_TILE : -((-cell-1)/COVERAGE_TILE)-1; }
+
+	void sweep(double x0, double y0, double x1, double y1);
+	void setSpan(int cy, int cx0, int cx1);
+	void grow(int tx, int ty);
+
+	void publish(const ros::Time& stamp);
+	bool published(int tx, int ty) const;
+	void fill(nav_msgs::OccupancyGrid& grid) const;
+	void fillTile(std::vector<int8_t>& data, int stride, int x, int y, const Tile* tile) const;
+	bool getCoverage(nav_msgs::GetMap::Request& req, nav_msgs::GetMap::Response& res);
+
+	double resolution_;
+	double radius_;
+	std::string frame_;
+
+	TileMap tiles_;
+	std::set<uint64_t> dirty_;
+
+	// extent in tiles, and the one last sent on /roomba/coverage
+	int ox_, oy_, w_, h_;
+	int pox_, poy_, pw_, ph_;
+	bool resized_;
+
+	bool has_pose_;
+	double x_, y_;
+
+	ros::Duration period_;
+	ros::Duration grid_period_;
+	ros::Time last_pub_;
+	ros::Time last_grid_;
+	ros::Time stamp_;
+	ros::Publisher pub_grid_;
+	ros::Publisher pub_update_;
+	ros::ServiceServer srv_;
+};	// class
+
+#endif	// _COVERAGE_GRID_H
@@ -0,0 +1,86 @@
+//---------------------------< /-/ AMSL /-/ >------------------------------
+/**
+ * file         :       dock_controller.h
+ *
+ *
+ * Environment  :       g++
+ *
+ */
+//-----------------------------------------------------------------------------
+
+#ifndef _DOCK_CONTROLLER_H
+#define _DOCK_CONTROLLER_H
+
+#include "ros/ros.h"
+#include "roomba_500driver_meiji/roomba500sci.h"
+#include <roomba_500driver_meiji/Roomba500State.h>
+
+#include <stdint.h>
+
+// IR codes of the home base (packets 17, 52, 53).
+// Roomba 500 bases send 160-175, Create 2 / 600 series bases 240-254
+// with the force field on another bit. dockBits() returns the 500 layout.
+const uint8_t IR_DOCK_MASK=0xf0;
+const uint8_t IR_DOCK=0xa0;			// 160, reserved
+const uint8_t IR_FORCE_FIELD=0x01;	// 161
+const uint8_t IR_GREEN_BUOY=0x04;	// 164, 244
+const uint8_t IR_RED_BUOY=0x08;		// 168, 248
+const uint8_t IR_DOCK_600=0xf0;			// 240, reserved
+const uint8_t IR_FORCE_FIELD_600=0x02;	// 242
+
+// Docking on the home base beacons, stepped once per sensor frame.
+// Turns until the front receivers see the dock, steers on the red and
+// green buoys, stops on a bump or the force field and waits for the
+// charger. Falls back to the firmware seek when it does not get there.
+class DockController {
+public:
+	enum STATE {
+		IDLE=0,
+		SEARCH,			// turning in place until a front receiver sees the dock
+		APPROACH,		// steering on the buoys
+		CONTACT,		// stopped, waiting for the charger
+		BACKOFF,		// reversing after a contact without charger
+		DOCKED,
+		FALLBACK		// handed over to the firmware seek
+	};
+
+	DockController(roombaSci* roomba, ros::NodeHandle& pn);
+
+	void start();
+	// another command took over
+	void cancel();
+	bool active() const { return state_!=IDLE && state_!=DOCKED && state_!=FALLBACK; }
+	STATE state() const { return state_; }
+
+	// for every valid frame
+	void update(const roomba_500driver_meiji::Roomba500State& sens);
+
+	// true when the base supplies power
+	static bool onCharger(const roomba_500driver_meiji::Roomba500State& sens);
+	// buoy and force field bits of one IR byte, 0 if it is not a dock code
+	static uint8_t dockBits(uint8_t code);
+
+protected:
+	void enter(STATE s);
+	void drive(float velocity, float yawrate);
+	void fallback(const char* reason);
+
+	roombaSci* roomba_;
+	STATE state_;
+	double start_;			// monotonic time of start()
+	double entered_;		// monotonic time of the current state
+	int contacts_;			// contacts without charger so far
+	float last_v_, last_w_;
+	float turn_sign_;		// direction of the search turn, follows the last sighting
+
+	double speed_;
+	double slow_speed_;
+	double turn_;
+	double timeout_;
+	double contact_wait_;
+	double backoff_time_;
+	int max_contacts_;
+	bool red_on_left_;
+};	// class
+
+#endif	// _DOCK_CONTROLLER_H
@@ -0,0 +1,95 @@
+//---------------------------< /-/ AMSL /-/ >------------------------------
+/**
+ * file         :       geofence.h
+ *
+ *
+ * Environment  :       g++
+ *
+ */
+//-----------------------------------------------------------------------------
+
+#ifndef _GEOFENCE_H
+#define _GEOFENCE_H
+
+#include "ros/ros.h"
+
+#include <boost/thread/mutex.hpp>
+#include <string>
+#include <vector>
+
+const int GEOFENCE_MIN_SAMPLES=4;	// predicted poses checked per command
+const int GEOFENCE_MAX_SAMPLES=64;
+
+// Keep-out polygons in the odom frame.
+// Zones are read from "~keep_out" (list of names) and
+// "~keep_out_zone/<name>" ([x0, y0, x1, y1, ...] in m).
+// The robot is a disc of ~geofence_radius around the pose.
+// A command is checked by predicting the pose over ~geofence_horizon sec,
+// with samples closer than the radius.
+// It is scaled down until the prediction stays outside every zone, or
+// stopped. Polygons are found through a grid of their bounding boxes,
+// so a check only visits the zones near the robot.
+class Geofence {
+public:
+	explicit Geofence(ros::NodeHandle& pn);
+
+	bool empty() const { return zones_.empty(); }
+
+	// roombaSci drive filter, velocity [m/s], yawrate [rad/s].
+	// may be called from any thread
+	void filter(float& velocity, float& yawrate);
+
+	// pose after an odometry update. returns true when the command the
+	// robot is still executing has to change, the new one is in
+	// velocity/yawrate
+	bool update(double x, double y, double theta, float& velocity, float& yawrate);
+
+	// whether the footprint at (x, y) overlaps a zone
+	bool inside(double x, double y) const;
+
+	// cost of the checks, for diagnostics
+	double meanCheckTime() const;
+	double maxCheckTime() const { return max_check_; }
+
+protected:
+	struct Zone {
+		std::string name;
+		std::vector<double> x;
+		std::vector<double> y;
+		double min_x, min_y, max_x, max_y;
+	};
+
+	// false if the command leads into a zone
+	bool clear(double x, double y, double theta, float velocity, float yawrate) const;
+	// called with mutex_ held
+	void limit(float& velocity, float& yawrate);
+	bool insideZone(const Zone& z, double x, double y) const;
+	// distance from (x, y) to the nearest zone near it, negative inside.
+	// zones farther than radius_ may be left out
+	double clearance(double x, double y) const;
+	static double edgeDistance(const Zone& z, double x, double y);
+	int cellIndex(double x, double y) const;
+	void buildIndex();
+
+	std::vector<Zone> zones_;
+
+	// grid over the bounding box of all zones, each cell lists the zones
+	// whose bounding box touches it
+	double cell_;
+	double origin_x_, origin_y_;
+	int cols_, rows_;
+	std::vector<std::vector<int> > cells_;
+
+	double horizon_;
+	double radius_;
+
+	boost::mutex mutex_;
+	double x_, y_, theta_;
+	float velocity_, yawrate_;		// last command after the filter
+
+	unsigned long checks_;
+	double total_check_;
+	double max_check_;
+};	// class
+
+#endif	// _GEOFENCE_H
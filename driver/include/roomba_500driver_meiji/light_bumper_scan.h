@@ -0,0 +1,57 @@
+//---------------------------< /-/ AMSL /-/ >------------------------------
+/**
+ * file         :       light_bumper_scan.h
+ *
+ *
+ * Environment  :       g++
+ *
+ */
+//-----------------------------------------------------------------------------
+
+#ifndef _LIGHT_BUMPER_SCAN_H
+#define _LIGHT_BUMPER_SCAN_H
+
+#include "ros/ros.h"
+#include <sensor_msgs/LaserScan.h>
+#include <roomba_500driver_meiji/Roomba500State.h>
+
+#include <string>
+#include <vector>
+
+// Turns the six light bumper intensities into a LaserScan with one range
+// per sensor. Intensity to range goes through per-sensor lookup tables
+// built once from the calibration parameters, so a frame costs one index
+// per sensor.
+class LightBumperScan {
+public:
+	// in scan order, right to left
+	enum SENSOR {
+		LB_RIGHT=0,
+		LB_FRONT_RIGHT,
+		LB_CENTER_RIGHT,
+		LB_CENTER_LEFT,
+		LB_FRONT_LEFT,
+		LB_LEFT,
+		LB_NUM
+	};
+
+	// light bumper signals are 12 bit
+	static const int LUT_SIZE=4096;
+
+	LightBumperScan(ros::NodeHandle& n, ros::NodeHandle& pn);
+
+	void publish(const roomba_500driver_meiji::Roomba500State& sens);
+
+	// range from the robot center [m], +inf when nothing is seen
+	float range(SENSOR s, int intensity) const;
+
+protected:
+	void buildLut(SENSOR s, const std::vector<double>& intensity, const std::vector<double>& range);
+
+	ros::Publisher pub_;
+	sensor_msgs::LaserScan scan_;
+
+	std::vector<float> lut_[LB_NUM];
+};	// class
+
+#endif	// _LIGHT_BUMPER_SCAN_H
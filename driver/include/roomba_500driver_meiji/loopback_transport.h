@@ -0,0 +1,62 @@
+//---------------------------< /-/ AMSL /-/ >------------------------------
+/**
+ * file         :       loopback_transport.h
+ *
+ *
+ * Environment  :       g++
+ *
+ */
+//-----------------------------------------------------------------------------
+
+#ifndef _LOOPBACK_TRANSPORT_H
+#define _LOOPBACK_TRANSPORT_H
+
+#include "transport.h"
+
+#include <vector>
+
+// In-memory transport for running the protocol layer without a robot.
+// Bytes given to inject() are returned by read(), and everything written
+// is kept in written() while recording is on. A Responder can play the
+// robot side.
+class LoopbackTransport : public Transport
+{
+public:
+
+	class Responder {
+	public:
+		virtual ~Responder(){}
+		// called for every write(). may call t.inject() to answer
+		virtual void received(LoopbackTransport& t, const unsigned char* p, int len)=0;
+	};
+
+	LoopbackTransport(Responder* responder=0);
+	~LoopbackTransport();
+
+	int read(unsigned char* p, int len);
+	int write(const unsigned char* p, int len);
+	int fd() const { return pipe_[0]; }
+	// creates the pipe if the constructor could not
+	bool open();
+
+	// queues bytes for read(). returns the number of bytes queued
+	int inject(const unsigned char* p, int len);
+
+	// off by default, nothing drains written() when the driver runs on
+	// loopback://
+	void setRecording(bool on){ recording_=on; }
+	const std::vector<unsigned char>& written() const { return written_; }
+	void clearWritten(){ written_.clear(); }
+
+	void setResponder(Responder* responder){ responder_=responder; }
+
+private:
+
+	int pipe_[2];
+	Responder* responder_;
+	bool recording_;
+	std::vector<unsigned char> written_;
+
+};
+
+#endif //_LOOPBACK_TRANSPORT_H
@@ -0,0 +1,75 @@
+//---------------------------< /-/ AMSL /-/ >------------------------------
+/**
+ * file         :       odometry_checkpoint.h
+ *
+ *
+ * Environment  :       g++
+ *
+ */
+//-----------------------------------------------------------------------------
+
+#ifndef _ODOMETRY_CHECKPOINT_H
+#define _ODOMETRY_CHECKPOINT_H
+
+#include <geometry_msgs/Pose2D.h>
+
+#include <stdint.h>
+#include <string>
+
+const uint32_t CHECKPOINT_MAGIC=0x524f4350;	// "ROCP"
+const uint32_t CHECKPOINT_VERSION=1;
+
+// Pose and encoder state in a small memory mapped file, written every
+// cycle so a restarted driver continues the odometry frame.
+// Two slots are written alternately, a slot is only used when its check
+// sum matches, so a crash in the middle of a write leaves the other one.
+class OdometryCheckpoint {
+public:
+	struct Record {
+		uint32_t sequence;
+		uint32_t check;
+		double stamp;			// wall time [sec]
+		double x, y, theta;
+		int64_t ticks_left;		// accumulated since the first start
+		int64_t ticks_right;
+		uint16_t encoder_left;	// raw counts of the last frame
+		uint16_t encoder_right;
+		uint32_t reserved;
+	};
+
+	explicit OdometryCheckpoint(const std::string& path);
+	~OdometryCheckpoint();
+
+	bool isOpen() const { return file_!=NULL; }
+
+	// newest valid record of the file, false when there is none
+	bool load(Record& rec) const;
+	// whether rec still fits the counts the robot reports
+	static bool matches(const Record& rec, unsigned short encoder_left, unsigned short encoder_right,
+		int tolerance, double max_age, double now);
+
+	void save(const geometry_msgs::Pose2D& pose, int d_ticks_left, int d_ticks_right,
+		unsigned short encoder_left, unsigned short encoder_right, double now);
+
+	// continues the tick counts of rec
+	void restore(const Record& rec);
+
+	int64_t ticksLeft() const { return ticks_left_; }
+	int64_t ticksRight() const { return ticks_right_; }
+
+protected:
+	struct File {
+		uint32_t magic;
+		uint32_t version;
+		Record slot[2];
+	};
+
+	static uint32_t checksum(const Record& rec);
+
+	File* file_;
+	uint32_t sequence_;
+	int64_t ticks_left_;
+	int64_t ticks_right_;
+};	// class
+
+#endif	// _ODOMETRY_CHECKPOINT_H
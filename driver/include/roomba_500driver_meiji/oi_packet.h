@@ -0,0 +1,174 @@
+//---------------------------< /-/ AMSL /-/ >------------------------------
+/**
+ * file         :       oi_packet.h
+ *
+ *
+ * Environment  :       g++
+ *
+ */
+//-----------------------------------------------------------------------------
+
+#ifndef _OI_PACKET_H
+#define _OI_PACKET_H
+
+// Layout of the reply to SENSORS ALL_PACKET (group 100, packets 7-58).
+// Multi byte values are big endian.
+
+const int ALL_PACKET_ID=100;
+const int ALL_PACKET_SIZE=80;
+
+enum ALL_PACKET_OFFSET {
+	OFS_BUMPS_WHEELDROPS	= 0,	// packet 7
+	OFS_WALL				= 1,	// packet 8
+	OFS_CLIFF_LEFT			= 2,	// packet 9
+	OFS_CLIFF_FRONT_LEFT	= 3,	// packet 10
+	OFS_CLIFF_FRONT_RIGHT	= 4,	// packet 11
+	OFS_CLIFF_RIGHT			= 5,	// packet 12
+	OFS_VIRTUAL_WALL		= 6,	// packet 13
+	OFS_OVERCURRENTS		= 7,	// packet 14
+	OFS_DIRT_DETECT			= 8,	// packet 15
+	OFS_UNUSED_1			= 9,	// packet 16
+	OFS_IR_OMNI				= 10,	// packet 17
+	OFS_BUTTONS				= 11,	// packet 18
+	OFS_DISTANCE			= 12,	// packet 19, int16
+	OFS_ANGLE				= 14,	// packet 20, int16
+	OFS_CHARGING_STATE		= 16,	// packet 21
+	OFS_VOLTAGE				= 17,	// packet 22, uint16
+	OFS_CURRENT				= 19,	// packet 23, int16
+	OFS_TEMPERATURE			= 21,	// packet 24, int8
+	OFS_CHARGE				= 22,	// packet 25, uint16
+	OFS_CAPACITY			= 24,	// packet 26, uint16
+	OFS_WALL_SIGNAL			= 26,	// packet 27, uint16
+	OFS_CLIFF_LEFT_SIGNAL			= 28,	// packet 28, uint16
+	OFS_CLIFF_FRONT_LEFT_SIGNAL		= 30,	// packet 29, uint16
+	OFS_CLIFF_FRONT_RIGHT_SIGNAL	= 32,	// packet 30, uint16
+	OFS_CLIFF_RIGHT_SIGNAL			= 34,	// packet 31, uint16
+	OFS_CHARGER_AVAILABLE	= 39,	// packet 34
+	OFS_OI_MODE				= 40,	// packet 35
+	OFS_SONG_NUMBER			= 41,	// packet 36
+	OFS_SONG_PLAYING		= 42,	// packet 37
+	OFS_STREAM_PACKETS		= 43,	// packet 38
+	OFS_REQUESTED_VELOCITY	= 44,	// packet 39, int16
+	OFS_REQUESTED_RADIUS	= 46,	// packet 40, int16
+	OFS_REQUESTED_RIGHT_VELOCITY	= 48,	// packet 41, int16
+	OFS_REQUESTED_LEFT_VELOCITY		= 50,	// packet 42, int16
+	OFS_ENCODER_LEFT		= 52,	// packet 43, uint16
+	OFS_ENCODER_RIGHT		= 54,	// packet 44, uint16
+	OFS_LIGHT_BUMPER		= 56,	// packet 45
+	OFS_LIGHT_BUMP_LEFT_SIGNAL			= 57,	// packet 46, uint16
+	OFS_LIGHT_BUMP_FRONT_LEFT_SIGNAL	= 59,	// packet 47, uint16
+	OFS_LIGHT_BUMP_CENTER_LEFT_SIGNAL	= 61,	// packet 48, uint16
+	OFS_LIGHT_BUMP_CENTER_RIGHT_SIGNAL	= 63,	// packet 49, uint16
+	OFS_LIGHT_BUMP_FRONT_RIGHT_SIGNAL	= 65,	// packet 50, uint16
+	OFS_LIGHT_BUMP_RIGHT_SIGNAL			= 67,	// packet 51, uint16
+	OFS_IR_LEFT				= 69,	// packet 52
+	OFS_IR_RIGHT			= 70,	// packet 53
+	OFS_LEFT_MOTOR_CURRENT	= 71,	// packet 54, int16
+	OFS_RIGHT_MOTOR_CURRENT	= 73,	// packet 55, int16
+	OFS_MAIN_BRUSH_CURRENT	= 75,	// packet 56, int16
+	OFS_SIDE_BRUSH_CURRENT	= 77,	// packet 57, int16
+	OFS_STASIS				= 79	// packet 58
+};
+
+inline unsigned short oiU16(const unsigned char* pack, int ofs){
+	return (unsigned short)((pack[ofs]<<8)|pack[ofs+1]);
+}
+
+inline short oiS16(const unsigned char* pack, int ofs){
+	return (short)((pack[ofs]<<8)|pack[ofs+1]);
+}
+
+inline unsigned char oiU8(const unsigned char* pack, int ofs){
+	return pack[ofs];
+}
+
+inline bool oiBit(const unsigned char* pack, int ofs, int bit){
+	return (bool)(0x01&(pack[ofs]>>bit));
+}
+
+// Decodes single fields of one ALL_PACKET reply on demand.
+// Does not copy the bytes, they have to outlive the view.
+class OIFrame {
+public:
+	explicit OIFrame(const unsigned char* pack=0) : pack_(pack) {}
+
+	const unsigned char* data() const { return pack_; }
+
+	unsigned char u8(int ofs) const { return oiU8(pack_, ofs); }
+	unsigned short u16(int ofs) const { return oiU16(pack_, ofs); }
+	short s16(int ofs) const { return oiS16(pack_, ofs); }
+	bool bit(int ofs, int b) const { return oiBit(pack_, ofs, b); }
+
+	bool bumpRight() const { return bit(OFS_BUMPS_WHEELDROPS, 0); }
+	bool bumpLeft() const { return bit(OFS_BUMPS_WHEELDROPS, 1); }
+	bool wheeldropRight() const { return bit(OFS_BUMPS_WHEELDROPS, 2); }
+	bool wheeldropLeft() const { return bit(OFS_BUMPS_WHEELDROPS, 3); }
+	bool wheeldropCaster() const { return bit(OFS_BUMPS_WHEELDROPS, 4); }
+
+	bool wall() const { return bit(OFS_WALL, 0); }
+	bool cliffLeft() const { return bit(OFS_CLIFF_LEFT, 0); }
+	bool cliffFrontLeft() const { return bit(OFS_CLIFF_FRONT_LEFT, 0); }
+	bool cliffFrontRight() const { return bit(OFS_CLIFF_FRONT_RIGHT, 0); }
+	bool cliffRight() const { return bit(OFS_CLIFF_RIGHT, 0); }
+	bool virtualWall() const { return bit(OFS_VIRTUAL_WALL, 0); }
+
+	// bit 0 side brush, 2 main brush, 3 right wheel, 4 left wheel
+	unsigned char overcurrents() const { return u8(OFS_OVERCURRENTS); }
+	unsigned char dirtDetect() const { return u8(OFS_DIRT_DETECT); }
+	unsigned char irOmni() const { return u8(OFS_IR_OMNI); }
+	unsigned char irLeft() const { return u8(OFS_IR_LEFT); }
+	unsigned char irRight() const { return u8(OFS_IR_RIGHT); }
+	unsigned char buttons() const { return u8(OFS_BUTTONS); }
+
+	// mm and degrees since the last request, unreliable on Create 2
+	short distance() const { return s16(OFS_DISTANCE); }
+	short angle() const { return s16(OFS_ANGLE); }
+
+	unsigned char chargingState() const { return u8(OFS_CHARGING_STATE); }
+	unsigned short voltage() const { return u16(OFS_VOLTAGE); }	// mV
+	short current() const { return s16(OFS_CURRENT); }				// mA
+	signed char temperature() const { return (signed char)u8(OFS_TEMPERATURE); }	// deg C
+	unsigned short charge() const { return u16(OFS_CHARGE); }		// mAh
+	unsigned short capacity() const { return u16(OFS_CAPACITY); }	// mAh
+
+	unsigned short wallSignal() const { return u16(OFS_WALL_SIGNAL); }
+	unsigned short cliffLeftSignal() const { return u16(OFS_CLIFF_LEFT_SIGNAL); }
+	unsigned short cliffFrontLeftSignal() const { return u16(OFS_CLIFF_FRONT_LEFT_SIGNAL); }
+	unsigned short cliffFrontRightSignal() const { return u16(OFS_CLIFF_FRONT_RIGHT_SIGNAL); }
+	unsigned short cliffRightSignal() const { return u16(OFS_CLIFF_RIGHT_SIGNAL); }
+
+	unsigned char chargerAvailable() const { return u8(OFS_CHARGER_AVAILABLE); }
+	unsigned char oiMode() const { return u8(OFS_OI_MODE); }
+	unsigned char songNumber() const { return u8(OFS_SONG_NUMBER); }
+	unsigned char songPlaying() const { return u8(OFS_SONG_PLAYING); }
+	unsigned char streamPackets() const { return u8(OFS_STREAM_PACKETS); }
+
+	short requestedVelocity() const { return s16(OFS_REQUESTED_VELOCITY); }	// mm/s
+	short requestedRadius() const { return s16(OFS_REQUESTED_RADIUS); }		// mm
+	short requestedRightVelocity() const { return s16(OFS_REQUESTED_RIGHT_VELOCITY); }
+	short requestedLeftVelocity() const { return s16(OFS_REQUESTED_LEFT_VELOCITY); }
+
+	unsigned short encoderLeft() const { return u16(OFS_ENCODER_LEFT); }
+	unsigned short encoderRight() const { return u16(OFS_ENCODER_RIGHT); }
+
+	// left, front left, center left, center right, front right, right from bit 0
+	unsigned char lightBumper() const { return u8(OFS_LIGHT_BUMPER); }
+	unsigned short lightBumpLeftSignal() const { return u16(OFS_LIGHT_BUMP_LEFT_SIGNAL); }
+	unsigned short lightBumpFrontLeftSignal() const { return u16(OFS_LIGHT_BUMP_FRONT_LEFT_SIGNAL); }
+	unsigned short lightBumpCenterLeftSignal() const { return u16(OFS_LIGHT_BUMP_CENTER_LEFT_SIGNAL); }
+	unsigned short lightBumpCenterRightSignal() const { return u16(OFS_LIGHT_BUMP_CENTER_RIGHT_SIGNAL); }
+	unsigned short lightBumpFrontRightSignal() const { return u16(OFS_LIGHT_BUMP_FRONT_RIGHT_SIGNAL); }
+	unsigned short lightBumpRightSignal() const { return u16(OFS_LIGHT_BUMP_RIGHT_SIGNAL); }
+
+	short leftMotorCurrent() const { return s16(OFS_LEFT_MOTOR_CURRENT); }	// mA
+	short rightMotorCurrent() const { return s16(OFS_RIGHT_MOTOR_CURRENT); }
+	short mainBrushCurrent() const { return s16(OFS_MAIN_BRUSH_CURRENT); }
+	short sideBrushCurrent() const { return s16(OFS_SIDE_BRUSH_CURRENT); }
+
+	bool stasis() const { return bit(OFS_STASIS, 0); }
+
+protected:
+	const unsigned char* pack_;
+};	// class
+
+#endif	// _OI_PACKET_H
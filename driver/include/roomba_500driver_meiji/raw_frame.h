@@ -0,0 +1,49 @@
+//---------------------------< /-/ AMSL /-/ >------------------------------
+/**
+ * file         :       raw_frame.h
+ *
+ *
+ * Environment  :       g++
+ *
+ */
+//-----------------------------------------------------------------------------
+
+#ifndef _RAW_FRAME_H
+#define _RAW_FRAME_H
+
+#include "roomba_500driver_meiji/oi_packet.h"
+#include <roomba_500driver_meiji/RawFrame.h>
+
+// Header only accessor for /roomba/raw_frames.
+// Fields are decoded when they are read, e.g.
+//
+//	void callback(const roomba_500driver_meiji::RawFrameConstPtr& msg){
+//		RawFrameView frame(*msg);
+//		if(frame.valid() && frame.bumpLeft()){ ... }
+//	}
+//
+// The view refers to the message, keep the message alive while using it.
+class RawFrameView : public OIFrame {
+public:
+	explicit RawFrameView(const roomba_500driver_meiji::RawFrame& msg)
+	:OIFrame(msg.data.empty() ? 0 : &msg.data[0]),msg_(msg){}
+
+	// an ALL_PACKET reply of full length, the only layout known here
+	bool valid() const {
+		return msg_.packet_ids.size()==1 && msg_.packet_ids[0]==ALL_PACKET_ID
+			&& msg_.data.size()==(size_t)ALL_PACKET_SIZE;
+	}
+
+	const ros::Time& stamp() const { return msg_.header.stamp; }
+
+	static void fill(roomba_500driver_meiji::RawFrame& msg, const ros::Time& stamp, const unsigned char* pack){
+		msg.header.stamp=stamp;
+		msg.packet_ids.assign(1, ALL_PACKET_ID);
+		msg.data.assign(pack, pack+ALL_PACKET_SIZE);
+	}
+
+protected:
+	const roomba_500driver_meiji::RawFrame& msg_;
+};	// class
+
+#endif	// _RAW_FRAME_H
@@ -21,23 +21,35 @@
 
 
 #include "serial.h"
+#include "timer.h"
+#include "transport.h"
 #include <sys/time.h>
 #include <unistd.h>
 
 #include <cmath>
+#include <cstdlib>
+#include <deque>
+#include <vector>
+#include <boost/function.hpp>
+#include <boost/thread/mutex.hpp>
 #include <roomba_500driver_meiji/Roomba500State.h>
 
-class Timer{
-public:
-	void sleep(float sec){
-		long usec=(long)(sec*1000000);
-		usleep(usec);
-	}
-};
-
 
 const float COMMAND_WAIT=0.01;	 // sec, this time is for Roomba 500 series
+const float RECEIVE_TIMEOUT=0.05; // sec, longest wait for a sensor packet
+const float PROBE_TIMEOUT=0.02; // sec, wait for the reply of one readiness probe
+const float STARTUP_TIMEOUT=2.0; // sec, give up waiting for the robot after this
+const int MAX_MISSED_FRAMES=10; // consecutive missing packets before the link is reopened
+const float RECONNECT_STARTUP_TIMEOUT=0.5; // sec, startup wait of one reconnect attempt
+const float RECONNECT_MIN_WAIT=0.1; // sec, first backoff between reconnect attempts
+const float RECONNECT_MAX_WAIT=2.0; // sec, longest backoff between reconnect attempts
 const short DEFAULT_VELOCITY=200; // mm/s
+const short MAX_WHEEL_VELOCITY=500; // mm/s, limit of DRIVE DIRECT
+const float ENCODER_TICKS_PER_MM=4.54; // 2270 ticks per 0.5 m, as the odometry counts them
+const float ENCODER_RESYNC_MARGIN=0.2; // sec added to an outage for the encoder plausibility bound
+const int ENCODER_RESYNC_MAX=30000; // ticks, larger deltas across an outage are not trusted
+const float CONFIRM_TIMEOUT=0.3; // sec, default wait for an async command to show up in the sensors
+const int CONFIRM_RETRIES=2; // default resends of an unconfirmed async command
 
 // DRIVE Special codes
 const short STRAIGHT_RADIUS=0x8000;
@@ -54,7 +66,9 @@ protected:
 
 	void packetToStruct(roomba_500driver_meiji::Roomba500State& ret, const unsigned char* pack);
 
-	Serial* ser_;
+	void init();
+
+	Transport* transport_;
 	unsigned char packet_[80];
 
 	unsigned int enc_count_l_;
@@ -64,6 +78,25 @@ protected:
 
 	int d_pre_enc_l_;
 	int d_pre_enc_r_;
+
+	bool valid_frame_;
+	bool enc_initialized_;
+	bool enc_resync_;		// the next frame is the first after a reconnect
+	bool enc_resynced_;		// the last deltas span a reconnect
+	double last_frame_time_;
+
+	int oi_mode_;
+	int confirmed_mode_;	// last mode reported by the robot, OI_UNKNOWN after a mode command
+
+	void linkLost(const char* reason);
+
+	bool connected_;
+	int missed_frames_;
+	double lost_time_;
+	double next_attempt_;
+	float backoff_;
+	unsigned int reconnects_;
+	double recovery_time_;
 public:
 
 	enum PACKET_ID{
@@ -77,7 +110,8 @@ public:
 		GROUP_101=101,
 		GROUP_106=106,
 		GROUP_107=107,
-		ALL_PACKET=100};
+		ALL_PACKET=100,
+		OI_MODE_PACKET=35};
 
 	enum OPCODE {
 		OC_START	= 128,
@@ -148,6 +182,15 @@ public:
 		BUTTON_CLOCK=0x80,
 	};
 
+	// open interface mode (packet 35)
+	enum OI_MODE {
+		OI_UNKNOWN	= -1,
+		OI_OFF		= 0,
+		OI_PASSIVE	= 1,
+		OI_SAFE		= 2,
+		OI_FULL		= 3
+	};
+
 	enum MOTOR{MOTOR_ON=1, MOTOR_OFF=0};
 	enum WALL{ NO_WALL=0, WALL_SEEN=1};
 	enum CLIRFF{ NO_CLIFF=0, CLIFF=1};
@@ -189,15 +232,39 @@ public:
 
 
 
+	// dev is passed to Transport::create()
 	roombaSci(int baud=B19200, const char* dev="/dev/ttyUSB0");
+	// takes ownership of transport
+	roombaSci(Transport* transport);
 	~roombaSci();
 
+	Transport* transport() const { return transport_; }
+
+	// The link is dropped on read/write errors or after MAX_MISSED_FRAMES
+	// missing packets. reconnect() then reopens the device with backoff
+	// and runs wakeup/startup again. Call it every cycle, it returns at
+	// once while waiting for the next attempt. The encoder baseline is
+	// taken again from the first packet after recovery.
+	bool connected() const { return connected_; }
+	bool reconnect();
+	unsigned int reconnectCount() const { return reconnects_; }
+	// sec from losing the link to the last recovery
+	double recoveryTime() const { return recovery_time_; }
+
 	void wakeup(void);
-	void startup();
+	// starts the OI and enters safe mode. returns false if the robot did
+	// not confirm it within timeout
+	bool startup(float timeout=STARTUP_TIMEOUT);
+	// asks for the OI mode (packet 35). returns it, or -1 without a reply
+	int queryMode(float timeout=PROBE_TIMEOUT);
+	// probes until the robot answers, in the given mode unless mode<0
+	bool waitReady(float timeout=STARTUP_TIMEOUT, int mode=-1);
 	void powerOff();
 	void clean();
-	void safe();
-	void full();
+	// mode commands are skipped when the mode is already in effect,
+	// unless force is set
+	void safe(bool force=false);
+	void full(bool force=false);
 	void spot();
 	void max();
 	void dock();
@@ -216,10 +283,67 @@ public:
 	short velToPWMLeft(float velocity);
 	float velToPWM(float velocity);
 
+	// Async commands do not sleep. They complete when the sensor packet
+	// read by getSensors() shows the requested state: open_interface_mode
+	// for mode changes, requested velocity/radius or wheel velocities for
+	// drive commands. An unconfirmed command is resent after timeout up to
+	// retries times, then done(false) is called. A newer command of the
+	// same kind, sync or async, cancels the pending one with done(false).
+	// Callbacks are called from getSensors().
+	typedef boost::function<void(bool)> CommandCallback;
+
+	void passiveAsync(CommandCallback done=CommandCallback(), float timeout=CONFIRM_TIMEOUT, int retries=CONFIRM_RETRIES, bool force=false);
+	void safeAsync(CommandCallback done=CommandCallback(), float timeout=CONFIRM_TIMEOUT, int retries=CONFIRM_RETRIES, bool force=false);
+	void fullAsync(CommandCallback done=CommandCallback(), float timeout=CONFIRM_TIMEOUT, int retries=CONFIRM_RETRIES, bool force=false);
+	void driveAsync(short velocity, short radius,
+		CommandCallback done=CommandCallback(), float timeout=CONFIRM_TIMEOUT, int retries=CONFIRM_RETRIES);
+	void driveDirectAsync(float velocity, float yawrate,
+		CommandCallback done=CommandCallback(), float timeout=CONFIRM_TIMEOUT, int retries=CONFIRM_RETRIES);
+
+	// every drive command passes through the filter before it is sent,
+	// velocity [m/s] and yawrate [rad/s] may be changed (e.g. Geofence)
+	typedef boost::function<void(float& velocity, float& yawrate)> DriveFilter;
+	void setDriveFilter(DriveFilter filter){ drive_filter_=filter; }
+
+	bool commandPending() const {
+		boost::mutex::scoped_lock lock(pending_mutex_);
+		return !pending_.empty();
+	}
+
 	int sendOPCODE(roombaSci::OPCODE);
 	int getSensors();
 	int getSensors(roomba_500driver_meiji::Roomba500State& sensor);
 
+	// getSensors() in steps, for a caller that guards the roomba with a
+	// lock but does not want to hold it while the packet arrives.
+	// requestSensors() and decodeSensors() need the lock, receiveSensors()
+	// only reads and may run beside a command from another thread.
+	// receiveSensors() is skipped when requestSensors() returned < 0.
+	int requestSensors();
+	int receiveSensors(){ return receive(); }
+	void decodeSensors(roomba_500driver_meiji::Roomba500State& sensor, int nbyte);
+
+	// true if the last getSensors() decoded a complete packet
+	bool validFrame() const { return valid_frame_; }
+	// bytes of the last ALL_PACKET reply, valid when validFrame()
+	const unsigned char* rawPacket() const { return packet_; }
+
+	// counts the last deltas from these raw counts instead of the previous
+	// frame, for a warm restart. Before the first frame it sets the baseline
+	void setEncoderBaseline(unsigned short left, unsigned short right);
+	// ticks from pre to count, across the 16 bit wrap
+	static int encoderDelta(unsigned int count, unsigned int pre);
+	// true if count is at most tolerance ticks away from pre
+	static bool encoderNear(unsigned int count, unsigned int pre, int tolerance){
+		return std::abs(encoderDelta(count, pre))<=tolerance;
+	}
+	// true if the last deltas are the motion while the link was down,
+	// so they may be larger than one cycle allows
+	bool encoderResynced() const { return enc_resynced_; }
+
+	// OI mode from the last packet, or the one just requested
+	OI_MODE mode() const { return (OI_MODE)oi_mode_; }
+
 	int dEncoderRight(int max_delta=200){
 		d_enc_count_r_=std::max(-max_delta,d_enc_count_r_);
 		d_enc_count_r_=std::min(max_delta,d_enc_count_r_);
@@ -233,6 +357,44 @@ public:
 	}
 
 	Timer* time_;
+
+protected:
+	enum CONFIRM_KIND {
+		CONFIRM_MODE,
+		CONFIRM_DRIVE,
+		CONFIRM_DRIVE_DIRECT
+	};
+
+	struct PendingCommand {
+		CONFIRM_KIND kind;
+		std::vector<unsigned char> seq;	// resent on retry
+		short expect_a;		// mode, velocity or right wheel
+		short expect_b;		// radius or left wheel
+		double deadline;
+		float timeout;
+		int retries;
+		CommandCallback done;
+	};
+
+	void driveSequence(unsigned char* seq, short velocity, short radius);
+	void driveDirectSequence(unsigned char* seq, float velocity, float yawrate);
+
+	void filterDrive(short& velocity, short& radius);
+	void filterDriveDirect(float& velocity, float& yawrate);
+	void filterPWM(int& right_pwm, int& left_pwm);
+
+	void assumeMode(int mode);
+	void modeAsync(OPCODE oc, OI_MODE mode, CommandCallback done, float timeout, int retries, bool force);
+	void sendAsync(CONFIRM_KIND kind, const unsigned char* seq, int len,
+		short expect_a, short expect_b, CommandCallback done, float timeout, int retries);
+	void cancelPending(CONFIRM_KIND kind);
+	void checkPending(const roomba_500driver_meiji::Roomba500State* sensor);
+
+	std::deque<PendingCommand> pending_;
+	// drive commands may come from another thread (TrajectoryExecutor)
+	mutable boost::mutex pending_mutex_;
+
+	DriveFilter drive_filter_;
 };	// class
 
 
@@ -0,0 +1,44 @@
+//---------------------------< /-/ AMSL /-/ >------------------------------
+/**
+ * file         :       sensor_events.h
+ *
+ *
+ * Environment  :       g++
+ *
+ */
+//-----------------------------------------------------------------------------
+
+#ifndef _SENSOR_EVENTS_H
+#define _SENSOR_EVENTS_H
+
+#include <stdint.h>
+
+#include <roomba_500driver_meiji/Roomba500State.h>
+#include <roomba_500driver_meiji/SensorEvent.h>
+
+// Detects transitions between two decoded frames.
+// All boolean fields are packed into one word, so the diff is a single XOR.
+class SensorEvents {
+public:
+	SensorEvents();
+
+	// packs the boolean fields with the SensorEvent bit layout
+	static uint32_t pack(const roomba_500driver_meiji::Roomba500State& sens);
+
+	// returns true and fills ev if anything changed since the last frame.
+	// the first frame only sets the reference.
+	bool update(const roomba_500driver_meiji::Roomba500State& sens,
+		roomba_500driver_meiji::SensorEvent& ev);
+
+	void reset(){ initialized_=false; }
+
+protected:
+	bool initialized_;
+	uint32_t bits_;
+	uint8_t opcode_left_;
+	uint8_t opcode_right_;
+	uint8_t remote_;
+	uint8_t charging_state_;
+};	// class
+
+#endif	// _SENSOR_EVENTS_H
@@ -0,0 +1,93 @@
+//---------------------------< /-/ AMSL /-/ >------------------------------
+/**
+ * file         :       sensor_history.h
+ *
+ *
+ * Environment  :       g++
+ *
+ */
+//-----------------------------------------------------------------------------
+
+#ifndef _SENSOR_HISTORY_H
+#define _SENSOR_HISTORY_H
+
+#include "ros/ros.h"
+#include "roomba_500driver_meiji/shared_state.h"
+#include "roomba_500driver_meiji/oi_packet.h"
+#include <roomba_500driver_meiji/Roomba500State.h>
+#include <roomba_500driver_meiji/DumpHistory.h>
+#include <geometry_msgs/Pose2D.h>
+#include <geometry_msgs/Twist.h>
+
+#include <boost/thread.hpp>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Ring of the last ~history_frames frames, raw bytes and decoded values,
+// allocated once at startup.
+// /roomba/dump_history writes a time window to files or returns it.
+// A rising edge of one of ~history_triggers dumps the window to
+// ~history_dir after ~history_post_seconds, so the aftermath is kept too.
+// Windows for files are copied out and written by a worker thread, the
+// driver loop does not wait for the files.
+class SensorHistory {
+public:
+	SensorHistory(ros::NodeHandle& n, ros::NodeHandle& pn);
+	// waits for a dump in progress
+	~SensorHistory();
+
+	// for every valid frame
+	void add(const roomba_500driver_meiji::Roomba500State& sens, const unsigned char* raw,
+		const geometry_msgs::Pose2D& pose, const geometry_msgs::Twist& cmd);
+
+	size_t size() const { return count_<entries_.size() ? count_ : entries_.size(); }
+
+protected:
+	struct Entry {
+		SharedStateData state;
+		unsigned char raw[ALL_PACKET_SIZE];
+	};
+
+	// entries of the last seconds, oldest first, as ring positions
+	void window(double seconds, size_t& first, size_t& n) const;
+	const Entry& at(size_t i) const { return entries_[i%entries_.size()]; }
+	static bool writeEntries(const std::string& path, const std::vector<Entry>& entries,
+		size_t first, size_t n, std::string& message);
+	// hands the window to the writer thread, false while it is busy
+	bool dumpAsync(const std::string& path, double seconds, size_t& n);
+	void writer();
+	bool dump(roomba_500driver_meiji::DumpHistory::Request& req,
+		roomba_500driver_meiji::DumpHistory::Response& res);
+
+	static uint32_t triggerMask(const std::string& name);
+	static bool drivingForward(const roomba_500driver_meiji::Roomba500State& sens);
+
+	std::vector<Entry> entries_;
+	unsigned long count_;			// frames added so far, the ring position is count_ % size
+
+	uint32_t trigger_mask_;
+	bool stuck_trigger_;			// stasis lost while driving forward
+	uint32_t last_bits_;
+	bool has_last_;
+	std::string dir_;
+	double window_;
+	double post_;
+	double dump_at_;				// monotonic time of the pending dump, 0 for none
+	std::string reason_;
+	double cooldown_until_;
+
+	ros::ServiceServer srv_;
+
+	// dumps to files, the copy is allocated with the ring
+	boost::mutex mutex_;
+	boost::condition_variable wakeup_;
+	std::vector<Entry> snapshot_;
+	size_t snapshot_n_;
+	std::string snapshot_path_;
+	bool busy_;						// snapshot_ belongs to the writer
+	bool quit_;
+	boost::thread thread_;
+};	// class
+
+#endif	// _SENSOR_HISTORY_H
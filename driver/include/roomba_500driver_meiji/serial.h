@@ -20,6 +20,8 @@
 #define _SERIAL_H
 
 #include <termios.h>
+#include <string>
+#include "transport.h"
 
 #define MODEMDEVICE1 "/dev/ttyS0"
 #define MODEMDEVICE_USB0 "/dev/ttyUSB0"
@@ -30,13 +32,16 @@
 
 //#define DEBUG
 
-class Serial
+class Serial : public Transport
 {
 private:
 
 	int fd_;//, c_, res_;
 	struct termios oldtio_, newtio_;
 
+	std::string device_;
+	int baudrate_;
+
 
 public:
 
@@ -45,8 +50,17 @@ public:
 
 	int read(unsigned char* p, int len);
 	int write(const unsigned char* p, int len);
+	int fd() const { return fd_; }
+	// opens the device by name again, so re-created udev links are followed.
+	// fails for a baud rate toTermiosBaud() does not know
+	bool open();
+	void close();
 	void setVmin(int vmin);  // non canonical 時のreadで待つ最低限の文字数
 	void setRts(int);
+	void drain();
+
+	// 115200 -> B115200. returns B0 for unsupported rates
+	static int toTermiosBaud(int bps);
 
 };
 
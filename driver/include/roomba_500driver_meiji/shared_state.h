@@ -0,0 +1,137 @@
+//---------------------------< /-/ AMSL /-/ >------------------------------
+/**
+ * file         :       shared_state.h
+ *
+ *
+ * Environment  :       g++
+ *
+ */
+//-----------------------------------------------------------------------------
+
+#ifndef _SHARED_STATE_H
+#define _SHARED_STATE_H
+
+// Latest robot state in POSIX shared memory, written by the driver when
+// ~shared_state is set. This header does not need ROS, link with -lrt.
+//
+// The segment is guarded by a seqlock: the writer makes sequence odd while
+// it writes, readers copy the data and retry when sequence was odd or has
+// changed. Readers never block the driver.
+
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <string>
+
+const uint32_t SHARED_STATE_MAGIC=0x524f4d42;	// "ROMB"
+const uint32_t SHARED_STATE_VERSION=1;
+
+// fixed layout, host byte order, every field naturally aligned
+struct SharedStateData {
+	double stamp;				// ROS time of the frame [sec]
+	double monotonic;			// CLOCK_MONOTONIC of the frame [sec], for the age
+	uint64_t frames;			// frames written so far
+
+	// SensorEvent bit layout (bumps, wheel drops, cliffs, walls,
+	// overcurrents, buttons, stasis, light bumpers)
+	uint32_t contacts;
+	uint16_t encoder_left;		// raw counts
+	uint16_t encoder_right;
+	int16_t light_bumper[6];	// left, front_left, center_left, center_right, front_right, right
+	int16_t cliff_signal[4];	// left, front_left, front_right, right
+	int16_t wall_signal;
+	int16_t requested_velocity_left;	// mm/s
+	int16_t requested_velocity_right;
+	int16_t current;			// mA
+	uint16_t voltage;			// mV
+	uint16_t charge;			// mAh
+	uint16_t capacity;			// mAh
+	uint8_t charging_state;
+	uint8_t oi_mode;
+	int8_t temperature;			// deg C
+	uint8_t connected;			// 0 after the link is lost or the driver exits
+	uint8_t ir_left;
+	uint8_t ir_right;
+	uint8_t ir_omni;
+	uint8_t reserved;
+
+	double x;					// odometry pose [m], [rad]
+	double y;
+	double theta;
+	double linear;				// commanded velocity [m/s], [rad/s]
+	double angular;
+};
+
+struct SharedState {
+	uint32_t magic;
+	uint32_t version;
+	volatile uint32_t sequence;
+	uint32_t size;				// sizeof(SharedStateData)
+	SharedStateData data;
+};
+
+class SharedStateReader {
+public:
+	SharedStateReader():state_(NULL){}
+	~SharedStateReader(){ close(); }
+
+	// name as given to the driver, e.g. "/roomba_state"
+	bool open(const std::string& name){
+		close();
+		int fd=shm_open(name.c_str(), O_RDONLY, 0);
+		if(fd<0){
+			return false;
+		}
+		void* p=mmap(NULL, sizeof(SharedState), PROT_READ, MAP_SHARED, fd, 0);
+		::close(fd);
+		if(p==MAP_FAILED){
+			return false;
+		}
+		state_=(const SharedState*)p;
+		if(state_->magic!=SHARED_STATE_MAGIC || state_->version!=SHARED_STATE_VERSION ||
+			state_->size!=sizeof(SharedStateData)){
+			close();
+			return false;
+		}
+		return true;
+	}
+
+	void close(){
+		if(state_){
+			munmap((void*)state_, sizeof(SharedState));
+			state_=NULL;
+		}
+	}
+
+	bool isOpen() const { return state_!=NULL; }
+
+	// copies a consistent snapshot, false if none was seen in tries attempts
+	bool read(SharedStateData& out, int tries=1000) const {
+		if(!state_){
+			return false;
+		}
+		for(int i=0; i<tries; i++){
+			uint32_t begin=state_->sequence;
+			if(begin&1){
+				continue;
+			}
+			__sync_synchronize();
+			memcpy(&out, (const void*)&state_->data, sizeof(out));
+			__sync_synchronize();
+			if(state_->sequence==begin){
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// changes every time the writer publishes, cheap test for new data
+	uint32_t sequence() const { return state_ ? state_->sequence : 0; }
+
+protected:
+	const SharedState* state_;
+};	// class
+
+#endif	// _SHARED_STATE_H
@@ -0,0 +1,47 @@
+//---------------------------< /-/ AMSL /-/ >------------------------------
+/**
+ * file         :       shared_state_writer.h
+ *
+ *
+ * Environment  :       g++
+ *
+ */
+//-----------------------------------------------------------------------------
+
+#ifndef _SHARED_STATE_WRITER_H
+#define _SHARED_STATE_WRITER_H
+
+#include "roomba_500driver_meiji/shared_state.h"
+#include <roomba_500driver_meiji/Roomba500State.h>
+#include <geometry_msgs/Pose2D.h>
+#include <geometry_msgs/Twist.h>
+
+// Writes the driver side of shared_state.h. There is a single writer,
+// the driver loop.
+class SharedStateWriter {
+public:
+	explicit SharedStateWriter(const std::string& name);
+	// marks the state as disconnected and removes the segment
+	~SharedStateWriter();
+
+	bool isOpen() const { return state_!=NULL; }
+
+	// called for every valid frame
+	void publish(const roomba_500driver_meiji::Roomba500State& sens, bool connected,
+		const geometry_msgs::Pose2D& pose, const geometry_msgs::Twist& cmd);
+	// copies the decoded state, frames is left alone
+	static void fill(SharedStateData& d, const roomba_500driver_meiji::Roomba500State& sens,
+		bool connected, const geometry_msgs::Pose2D& pose, const geometry_msgs::Twist& cmd);
+
+	// only changes the connected flag, for cycles without a frame
+	void setConnected(bool connected);
+
+protected:
+	void begin();
+	void end();
+
+	std::string name_;
+	SharedState* state_;
+};	// class
+
+#endif	// _SHARED_STATE_WRITER_H
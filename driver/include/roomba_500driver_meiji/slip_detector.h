@@ -0,0 +1,71 @@
+//---------------------------< /-/ AMSL /-/ >------------------------------
+/**
+ * file         :       slip_detector.h
+ *
+ *
+ * Environment  :       g++
+ *
+ */
+//-----------------------------------------------------------------------------
+
+#ifndef _SLIP_DETECTOR_H
+#define _SLIP_DETECTOR_H
+
+#include "ros/ros.h"
+#include <roomba_500driver_meiji/Roomba500State.h>
+#include <roomba_500driver_meiji/SlipEvent.h>
+
+#include <stdint.h>
+
+// Compares the requested wheel speeds (packets 39-42) with the encoder
+// rates and the stasis bit, frame by frame, with smoothed values only.
+// A condition has to last ~slip_time before it is flagged.
+// The result scales the odometry covariance and changes go out on
+// /roomba/slip.
+class SlipDetector {
+public:
+	SlipDetector(ros::NodeHandle& n, ros::NodeHandle& pn);
+
+	// for every valid frame, encoder deltas already filtered for glitches
+	void update(const roomba_500driver_meiji::Roomba500State& sens, int d_enc_left, int d_enc_right);
+
+	// lost frames say nothing about slip
+	void reset();
+
+	uint8_t flags() const { return flags_; }
+	// 1 without slip
+	double covarianceScale() const { return scale_; }
+
+	// wheel speeds the robot reports as requested [mm/s], from the wheel
+	// velocities or else from velocity and radius, whatever drive command
+	// set them
+	static void requested(const roomba_500driver_meiji::Roomba500State& sens, float& left, float& right);
+
+protected:
+	enum WHEEL { LEFT=0, RIGHT, NUM_WHEELS };
+
+	double last_time_;
+	bool initialized_;
+
+	float req_[NUM_WHEELS];		// mm/s, smoothed
+	float meas_[NUM_WHEELS];
+	// how long each condition has held [sec]
+	double slip_for_[NUM_WHEELS];
+	double stall_for_[NUM_WHEELS];
+	double no_progress_for_;
+
+	uint8_t flags_;
+	double scale_;
+
+	double gain_;
+	double min_speed_;
+	double slip_ratio_;
+	double stall_ratio_;
+	double hold_time_;
+	double slip_scale_;
+	double stall_scale_;
+
+	ros::Publisher pub_;
+};	// class
+
+#endif	// _SLIP_DETECTOR_H
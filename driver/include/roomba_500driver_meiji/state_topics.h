@@ -0,0 +1,46 @@
+//---------------------------< /-/ AMSL /-/ >------------------------------
+/**
+ * file         :       state_topics.h
+ *
+ *
+ * Environment  :       g++
+ *
+ */
+//-----------------------------------------------------------------------------
+
+#ifndef _STATE_TOPICS_H
+#define _STATE_TOPICS_H
+
+#include "ros/ros.h"
+#include <roomba_500driver_meiji/Roomba500State.h>
+
+#include <string>
+
+// Publishes parts of Roomba500State on their own topics.
+// Each topic has its own rate divider and is only built when someone
+// subscribes to it.
+class StateTopics {
+public:
+	enum TOPIC {
+		T_CONTACT=0,
+		T_LIGHT_BUMPER,
+		T_ENCODERS,
+		T_BATTERY,
+		T_BUTTONS,
+		T_NUM
+	};
+
+	// dividers are read from "<topic>_divider" of the private node handle
+	StateTopics(ros::NodeHandle& n, ros::NodeHandle& pn, const std::string& prefix="/roomba/states/");
+
+	void publish(const roomba_500driver_meiji::Roomba500State& sens);
+
+protected:
+	bool due(TOPIC t);
+
+	ros::Publisher pub_[T_NUM];
+	int divider_[T_NUM];
+	unsigned long cycle_;
+};	// class
+
+#endif	// _STATE_TOPICS_H
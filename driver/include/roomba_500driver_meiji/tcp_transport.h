@@ -0,0 +1,47 @@
+//---------------------------< /-/ AMSL /-/ >------------------------------
+/**
+ * file         :       tcp_transport.h
+ *
+ *
+ * Environment  :       g++
+ *
+ */
+//-----------------------------------------------------------------------------
+
+#ifndef _TCP_TRANSPORT_H
+#define _TCP_TRANSPORT_H
+
+#include "transport.h"
+
+#include <sys/socket.h>
+#include <string>
+
+// sec, kept below the shortest reconnect backoff (RECONNECT_MIN_WAIT)
+const float TCP_CONNECT_TIMEOUT=0.1;
+
+// Raw TCP connection to a serial bridge (ser2net "raw" mode, ESP WiFi
+// bridges, ...). Bytes are passed through unchanged.
+class TcpTransport : public Transport
+{
+private:
+
+	int fd_;
+	std::string address_;
+
+	static bool connectFd(int fd, const struct sockaddr* addr, socklen_t len, double deadline);
+
+public:
+
+	// address is "host:port"
+	TcpTransport(const char* address);
+	~TcpTransport();
+
+	int read(unsigned char* p, int len);
+	int write(const unsigned char* p, int len);
+	int fd() const { return fd_; }
+	bool open();
+	void close();
+
+};
+
+#endif //_TCP_TRANSPORT_H
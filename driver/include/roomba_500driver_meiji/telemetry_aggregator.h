@@ -0,0 +1,71 @@
+//---------------------------< /-/ AMSL /-/ >------------------------------
+/**
+ * file         :       telemetry_aggregator.h
+ *
+ *
+ * Environment  :       g++
+ *
+ */
+//-----------------------------------------------------------------------------
+
+#ifndef _TELEMETRY_AGGREGATOR_H
+#define _TELEMETRY_AGGREGATOR_H
+
+#include "ros/ros.h"
+#include <roomba_500driver_meiji/Roomba500State.h>
+#include <roomba_500driver_meiji/AnalogTelemetry.h>
+
+// Accumulates the 16 bit analog readings between publishes and publishes
+// min/max/mean/last of each at a low rate. Every frame of the interval is
+// counted whatever the loop rate, so short spikes are kept without
+// logging every frame.
+class TelemetryAggregator {
+public:
+	enum SIGNAL {
+		S_VOLTAGE=0,
+		S_CURRENT,
+		S_WALL,
+		S_CLIFF_LEFT,
+		S_CLIFF_FRONT_LEFT,
+		S_CLIFF_FRONT_RIGHT,
+		S_CLIFF_RIGHT,
+		S_LB_LEFT,
+		S_LB_FRONT_LEFT,
+		S_LB_CENTER_LEFT,
+		S_LB_CENTER_RIGHT,
+		S_LB_FRONT_RIGHT,
+		S_LB_RIGHT,
+		S_NUM
+	};
+
+	// reads "telemetry_rate" [Hz]
+	TelemetryAggregator(ros::NodeHandle& n, ros::NodeHandle& pn);
+
+	// adds one decoded frame and publishes when the period has passed
+	void update(const roomba_500driver_meiji::Roomba500State& sens);
+
+	void add(const roomba_500driver_meiji::Roomba500State& sens);
+	void fill(roomba_500driver_meiji::AnalogTelemetry& msg) const;
+	// starts the next interval
+	void reset();
+
+protected:
+	void stats(SIGNAL s, roomba_500driver_meiji::SignalStats& out) const;
+
+	ros::Publisher pub_;
+	ros::Duration period_;
+	ros::Time last_pub_;
+
+	// since the last publish
+	int count_;
+	float min_[S_NUM];
+	float max_[S_NUM];
+	double sum_[S_NUM];
+	float last_[S_NUM];
+	ros::Time first_stamp_;
+
+	ros::Time last_stamp_;
+	double drawn_mah_;
+};	// class
+
+#endif	// _TELEMETRY_AGGREGATOR_H
@@ -0,0 +1,46 @@
+//---------------------------< /-/ AMSL /-/ >------------------------------
+/**
+ * file         :       timer.h
+ *
+ *
+ * Environment  :       g++
+ *
+ */
+//-----------------------------------------------------------------------------
+
+#ifndef _TIMER_H
+#define _TIMER_H
+
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "roomba_500driver_meiji/trace.h"
+
+class Timer{
+public:
+	void sleep(float sec){
+		ROOMBA_TRACE_SCOPE("sleep");
+		long usec=(long)(sec*1000000);
+		usleep(usec);
+	}
+
+	// sleeps until the monotonic time t in sec, see now()
+	static void sleepUntil(double t){
+		ROOMBA_TRACE_SCOPE("sleep");
+		struct timespec ts;
+		ts.tv_sec=(time_t)t;
+		ts.tv_nsec=(long)((t-ts.tv_sec)*1e9);
+		while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL)==EINTR){
+		}
+	}
+
+	// monotonic clock in sec, not affected by system time changes
+	static double now(){
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return ts.tv_sec+ts.tv_nsec*1e-9;
+	}
+};
+
+#endif	// _TIMER_H
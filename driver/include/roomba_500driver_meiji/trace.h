@@ -0,0 +1,71 @@
+//---------------------------< /-/ AMSL /-/ >------------------------------
+/**
+ * file         :       trace.h
+ *
+ *
+ * Environment  :       g++
+ *
+ */
+//-----------------------------------------------------------------------------
+
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include <cstddef>
+#include <string>
+
+// Spans of the driver cycle, written as Chrome trace-event JSON
+// (chrome://tracing, Perfetto).
+// ROOMBA_TRACE_SCOPE("name") records the time until the end of the scope.
+// Without ROOMBA_ENABLE_TRACE the macro is empty, with it a disabled span
+// costs one flag test. Names must be string literals, only the pointer is kept.
+class Trace {
+public:
+	// spans kept per thread, older ones are overwritten
+	static const int CAPACITY=65536;
+
+	// starts recording, the spans are written to path by stop()
+	static void start(const std::string& path);
+	// stops recording and writes the file, returns false on write errors
+	static bool stop();
+
+	static bool enabled() { return enabled_; }
+
+	// called by TraceScope when enabled
+	static double now();
+	static void record(const char* name, double begin, double end);
+
+protected:
+	static volatile bool enabled_;
+};	// class
+
+// inline so that a disabled span does not cost a call
+class TraceScope {
+public:
+	explicit TraceScope(const char* name)
+	:name_(NULL),begin_(0){
+		if(Trace::enabled()){
+			name_=name;
+			begin_=Trace::now();
+		}
+	}
+	~TraceScope(){
+		if(name_){
+			Trace::record(name_, begin_, Trace::now());
+		}
+	}
+
+protected:
+	const char* name_;
+	double begin_;
+};	// class
+
+#ifdef ROOMBA_ENABLE_TRACE
+#define ROOMBA_TRACE_CONCAT_(a, b) a##b
+#define ROOMBA_TRACE_CONCAT(a, b) ROOMBA_TRACE_CONCAT_(a, b)
+#define ROOMBA_TRACE_SCOPE(name) TraceScope ROOMBA_TRACE_CONCAT(trace_scope_, __LINE__)(name)
+#else
+#define ROOMBA_TRACE_SCOPE(name) do{}while(0)
+#endif
+
+#endif	// _TRACE_H
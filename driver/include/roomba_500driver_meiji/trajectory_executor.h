@@ -0,0 +1,65 @@
+//---------------------------< /-/ AMSL /-/ >------------------------------
+/**
+ * file         :       trajectory_executor.h
+ *
+ *
+ * Environment  :       g++
+ *
+ */
+//-----------------------------------------------------------------------------
+
+#ifndef _TRAJECTORY_EXECUTOR_H
+#define _TRAJECTORY_EXECUTOR_H
+
+#include "roomba_500driver_meiji/roomba500sci.h"
+#include <roomba_500driver_meiji/Trajectory.h>
+
+#include <boost/thread.hpp>
+
+const float TRAJECTORY_POLL=0.005;	// sec, how often encoders and pre-emption are checked
+
+// Runs a Trajectory on its own thread. Segment switches are scheduled
+// against the monotonic clock from the start of the trajectory, so timing
+// errors do not add up. A segment ended early by its encoder condition
+// moves the schedule of the following ones.
+class TrajectoryExecutor {
+public:
+	// io_mutex guards every access to roomba
+	TrajectoryExecutor(roombaSci* roomba, boost::mutex& io_mutex);
+	~TrajectoryExecutor();
+
+	// replaces the running trajectory, an empty one stops the robot
+	void start(const roomba_500driver_meiji::Trajectory& trajectory);
+	// stops executing without sending a command, for when another
+	// command takes over
+	void cancel();
+	bool running() const;
+
+	// motion measured since the last call, from the encoders
+	void addOdometry(float distance, float angle);
+
+protected:
+	void run();
+	// false when pre-empted
+	bool execute(const roomba_500driver_meiji::Trajectory& trajectory, unsigned long generation);
+	bool reached(const roomba_500driver_meiji::TrajectorySegment& segment) const;
+	// sends unless pre-empted, starts the encoder condition over
+	bool send(unsigned long generation, float velocity, float yawrate);
+
+	roombaSci* roomba_;
+	boost::mutex& io_mutex_;
+
+	mutable boost::mutex mutex_;
+	boost::condition_variable wakeup_;
+	roomba_500driver_meiji::Trajectory trajectory_;
+	unsigned long generation_;		// changed by start() and cancel()
+	bool has_work_;
+	bool running_;
+	bool quit_;
+	float distance_;			// since the start of the segment
+	float angle_;
+
+	boost::thread thread_;
+};	// class
+
+#endif	// _TRAJECTORY_EXECUTOR_H
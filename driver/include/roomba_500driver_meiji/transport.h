@@ -0,0 +1,57 @@
+//---------------------------< /-/ AMSL /-/ >------------------------------
+/**
+ * file         :       transport.h
+ *
+ *
+ * Environment  :       g++
+ *
+ */
+//-----------------------------------------------------------------------------
+
+#ifndef _TRANSPORT_H
+#define _TRANSPORT_H
+
+// Byte stream to the Open Interface.
+// Every backend does non-blocking reads and exposes a file descriptor
+// which becomes readable when read() has data, so all of them can be
+// waited on with poll().
+class Transport
+{
+public:
+	virtual ~Transport(){}
+
+	// returns the number of bytes read, 0 if nothing is available, -1 on error
+	virtual int read(unsigned char* p, int len)=0;
+	// writes all bytes. returns len, or -1 on error
+	virtual int write(const unsigned char* p, int len)=0;
+	// readiness descriptor, -1 while closed
+	virtual int fd() const=0;
+
+	// (re)opens the link. returns false if the device is not there
+	virtual bool open(){ return true; }
+	virtual void close(){}
+	virtual bool isOpen() const { return fd()>=0; }
+	// BRC line used by wakeup. only meaningful for serial
+	virtual void setRts(int){}
+	// waits until written bytes have left the host
+	virtual void drain(){}
+
+	// waits until fd() is readable or sec passes
+	bool waitReadable(float sec);
+	// reads until len bytes arrive or timeout passes. returns the bytes read,
+	// or -1 if the link failed before anything arrived
+	int readFull(unsigned char* p, int len, float timeout);
+	// discards any pending input
+	void flushInput();
+
+	// "tcp://host:port" : TCP bridge such as ser2net in raw mode
+	// "loopback://"     : in-memory loopback
+	// anything else     : serial device, baud is a termios constant
+	static Transport* create(const char* dev, int baud);
+
+protected:
+	static int readFd(int fd, unsigned char* p, int len);
+	static int writeFd(int fd, const unsigned char* p, int len);
+};
+
+#endif //_TRANSPORT_H
@@ -19,34 +19,71 @@
 #include "ros/ros.h"
 
 #include "roomba_500driver_meiji/roomba500sci.h"
+#include "roomba_500driver_meiji/state_topics.h"
+#include "roomba_500driver_meiji/sensor_events.h"
+#include "roomba_500driver_meiji/telemetry_aggregator.h"
+#include "roomba_500driver_meiji/light_bumper_scan.h"
+#include "roomba_500driver_meiji/adaptive_rate.h"
+#include "roomba_500driver_meiji/oi_packet.h"
+#include "roomba_500driver_meiji/command_arbiter.h"
+#include "roomba_500driver_meiji/trace.h"
+#include "roomba_500driver_meiji/trajectory_executor.h"
+#include "roomba_500driver_meiji/shared_state_writer.h"
+#include "roomba_500driver_meiji/coverage_grid.h"
+#include "roomba_500driver_meiji/geofence.h"
+#include "roomba_500driver_meiji/sensor_history.h"
+#include "roomba_500driver_meiji/dock_controller.h"
+#include "roomba_500driver_meiji/slip_detector.h"
+#include "roomba_500driver_meiji/raw_frame.h"
+#include "roomba_500driver_meiji/odometry_checkpoint.h"
 #include <roomba_500driver_meiji/Roomba500State.h>
 #include <roomba_500driver_meiji/RoombaCtrl.h>
 
 #include <tf/transform_broadcaster.h>
 #include <geometry_msgs/Pose2D.h>
+#include <geometry_msgs/Twist.h>
 #include <nav_msgs/Odometry.h>
 
 #include <boost/thread.hpp>
+#include <boost/bind.hpp>
 boost::mutex cntl_mutex_;
 
 #include <iostream>
+#include <algorithm>
 #include <math.h>
 using namespace std;
 
 roombaSci* roomba;
+TrajectoryExecutor* trajectory_executor;
+DockController* dock_controller;
 roomba_500driver_meiji::RoombaCtrl roombactrl;
 
-void cntl_callback(const roomba_500driver_meiji::RoombaCtrlConstPtr& msg){
-	roombactrl = *msg;
-	boost::mutex::scoped_lock(cntl_mutex_);
+void mode_done(const char* mode, bool ok){
+	if(!ok){
+		ROS_WARN("roomba did not enter %s mode", mode);
+	}
+}
+
+void trajectory_callback(const roomba_500driver_meiji::TrajectoryConstPtr& msg){
+	trajectory_executor->start(*msg);
+}
+
+// called by the CommandArbiter for the command of the source in control
+void executeCommand(const roomba_500driver_meiji::RoombaCtrl& cmd){
+	ROOMBA_TRACE_SCOPE("execute_command");
+	boost::mutex::scoped_lock lock(cntl_mutex_);
+	// any other command takes over from a running trajectory or docking
+	trajectory_executor->cancel();
+	dock_controller->cancel();
+	roombactrl = cmd;
 
-	switch(msg->mode){
+	switch(cmd.mode){
 		case roomba_500driver_meiji::RoombaCtrl::SPOT:
 			roomba->spot();
 			break;
 
 		case roomba_500driver_meiji::RoombaCtrl::SAFE:
-			roomba->safe();
+			roomba->safeAsync(boost::bind(mode_done, "SAFE", _1));
 			break;
 
 		case roomba_500driver_meiji::RoombaCtrl::CLEAN:
@@ -63,7 +100,7 @@ void cntl_callback(const roomba_500driver_meiji::RoombaCtrlConstPtr& msg){
 			break;
 
 		case roomba_500driver_meiji::RoombaCtrl::FULL:
-			roomba->full();
+			roomba->fullAsync(boost::bind(mode_done, "FULL", _1));
 			break;
 
 		case roomba_500driver_meiji::RoombaCtrl::MAX:
@@ -74,6 +111,14 @@ void cntl_callback(const roomba_500driver_meiji::RoombaCtrlConstPtr& msg){
 			roomba->dock();
 			break;
 
+		case roomba_500driver_meiji::RoombaCtrl::FORCE_SEEK_DOCK:
+			roomba->forceSeekingDock();
+			break;
+
+		case roomba_500driver_meiji::RoombaCtrl::FAST_DOCK:
+			dock_controller->start();
+			break;
+
 		case roomba_500driver_meiji::RoombaCtrl::MOTORS:
 			roomba->driveMotors((roombaSci::MOTOR_BITS)(roombaSci::MB_MAIN_BRUSH | roombaSci::MB_SIDE_BRUSH | roombaSci::MB_VACUUM));
 			break;
@@ -83,26 +128,37 @@ void cntl_callback(const roomba_500driver_meiji::RoombaCtrlConstPtr& msg){
 			break;
 
 		case roomba_500driver_meiji::RoombaCtrl::DRIVE_DIRECT:
-			roomba->driveDirect(msg->cntl.linear.x, msg->cntl.angular.z);
+			roomba->driveDirect(cmd.cntl.linear.x, cmd.cntl.angular.z);
 			break;
 
 		case roomba_500driver_meiji::RoombaCtrl::DRIVE_PWM:
-			roomba->drivePWM(msg->r_pwm, msg->l_pwm);
+			roomba->drivePWM(cmd.r_pwm, cmd.l_pwm);
 			break;
 
 		case roomba_500driver_meiji::RoombaCtrl::SONG:
-			roomba->safe();
 			roomba->song(1,1);
 			roomba->playing(1);
 			break;
 
 		case roomba_500driver_meiji::RoombaCtrl::DRIVE:
 		default:
-			roomba->drive(msg->velocity, msg->radius);
+			roomba->drive(cmd.velocity, cmd.radius);
 
 	}
 }
 
+// called by the CommandArbiter when the source in control stops sending
+// drive commands; docking and trajectories drive on their own
+void stopDrive(){
+	boost::mutex::scoped_lock lock(cntl_mutex_);
+	if(trajectory_executor->running() || dock_controller->active()){
+		return;
+	}
+	roombactrl = roomba_500driver_meiji::RoombaCtrl();
+	roombactrl.mode = roomba_500driver_meiji::RoombaCtrl::DRIVE_DIRECT;
+	roomba->driveDirect(0, 0);
+}
+
 void printSensors(const roomba_500driver_meiji::Roomba500State& sens){
 
 	cout<<"\n\n-------------------"<<endl;
@@ -156,6 +212,7 @@ void calcOdometry(
 	float dist,
 	float angle)
 {
+	ROOMBA_TRACE_SCOPE("odometry");
 
 	x.theta=pre_x.theta+angle;
 	x.theta=piToPI(x.theta);
@@ -165,22 +222,155 @@ void calcOdometry(
 
 int main(int argc, char** argv) {
 
-	roomba = new roombaSci(B115200,"/dev/ttyUSB0");
-	roomba->wakeup();
-	roomba->startup();
+	double start_time=Timer::now();
+	bool first_frame=true, first_odometry=true;
 
 	ros::init(argc, argv, "roomba_driver");
 	ros::NodeHandle n;
+	ros::NodeHandle pn("~");
 
-	ros::Subscriber cntl_sub = n.subscribe("/roomba/control", 100, cntl_callback);
+	std::string device;
+	int baud;
+	pn.param("device", device, std::string("/dev/ttyUSB0"));
+	pn.param("baud", baud, 115200);
+
+	if(Serial::toTermiosBaud(baud)==B0){
+		ROS_ERROR("unsupported baud rate %d, the serial port cannot be opened "
+			"(300, 600, 1200, 2400, 4800, 9600, 19200, 38400, 57600, 115200)", baud);
+	}
+	roomba = new roombaSci(Serial::toTermiosBaud(baud), device.c_str());
+	if(roomba->connected()){
+		roomba->wakeup();
+		if(!roomba->startup()){
+			ROS_WARN("roomba did not answer within %.1f sec", STARTUP_TIMEOUT);
+		}
+	}else{
+		ROS_WARN("%s is not available, retrying", device.c_str());
+	}
+
+	// commands are tiny, so do not let Nagle hold them back.
+	// UDPROS is tried first when requested and TCPROS is the fallback.
+	bool use_udp;
+	pn.param("use_udp", use_udp, false);
+	ros::TransportHints hints;
+	if(use_udp){
+		hints.udp();
+	}
+	hints.tcp().tcpNoDelay();
+
+	// /roomba/control and cmd_vel unless other sources are configured
+	CommandArbiter arbiter(n, pn, executeCommand, stopDrive, hints);
+
+	// segments are timed by the executor thread, not by this loop
+	trajectory_executor = new TrajectoryExecutor(roomba, cntl_mutex_);
+	dock_controller = new DockController(roomba, pn);
+	ros::Subscriber trajectory_sub = n.subscribe("/roomba/trajectory", 1, trajectory_callback, hints);
 
 	ros::Publisher pub_state=n.advertise<roomba_500driver_meiji::Roomba500State>("/roomba/states", 100);
 
+	// compact form of /roomba/states, decoded by the subscribers
+	bool use_raw_frames;
+	pn.param("raw_frames", use_raw_frames, false);
+	ros::Publisher pub_raw;
+	if(use_raw_frames){
+		pub_raw=n.advertise<roomba_500driver_meiji::RawFrame>("/roomba/raw_frames", 100);
+	}
+	roomba_500driver_meiji::RawFrame raw_frame;
+
+	bool split_states;
+	pn.param("split_states", split_states, false);
+	StateTopics* state_topics=NULL;
+	if(split_states){
+		state_topics=new StateTopics(n, pn);
+	}
+
+	ros::Publisher pub_event=n.advertise<roomba_500driver_meiji::SensorEvent>("/roomba/events", 100);
+	SensorEvents sensor_events;
+	TelemetryAggregator telemetry(n, pn);
+	SlipDetector slip(n, pn);
+
+	// odometry covariance without slip, scaled by the slip detector
+	double cov_xy, cov_yaw, cov_vx, cov_wz;
+	pn.param("odom_covariance_xy", cov_xy, 1e-3);
+	pn.param("odom_covariance_yaw", cov_yaw, 1e-2);
+	pn.param("odom_covariance_vx", cov_vx, 1e-3);
+	pn.param("odom_covariance_wz", cov_wz, 1e-2);
+
+	bool use_light_bumper_scan;
+	pn.param("light_bumper_scan", use_light_bumper_scan, false);
+	LightBumperScan* light_bumper_scan=NULL;
+	if(use_light_bumper_scan){
+		light_bumper_scan=new LightBumperScan(n, pn);
+	}
+
+	// latest state for local non-ROS processes, see shared_state.h
+	std::string shared_state_name;
+	pn.param("shared_state", shared_state_name, std::string(""));
+	SharedStateWriter* shared_state=NULL;
+	if(!shared_state_name.empty()){
+		shared_state=new SharedStateWriter(shared_state_name);
+	}
+
+	bool use_coverage;
+	pn.param("coverage", use_coverage, false);
+	CoverageGrid* coverage=NULL;
+	if(use_coverage){
+		coverage=new CoverageGrid(n, pn);
+	}
+
+	// keep-out zones, every drive command is checked before it is sent
+	Geofence* geofence=new Geofence(pn);
+	if(geofence->empty()){
+		delete geofence;
+		geofence=NULL;
+	}else{
+		roomba->setDriveFilter(boost::bind(&Geofence::filter, geofence, _1, _2));
+	}
+
+	bool use_history;
+	pn.param("history", use_history, false);
+	SensorHistory* history=NULL;
+	if(use_history){
+		history=new SensorHistory(n, pn);
+	}
+
+	// pose and encoder counts survive a restart of the node
+	std::string checkpoint_file;
+	int checkpoint_tolerance;
+	double checkpoint_max_age;
+	pn.param("checkpoint", checkpoint_file, std::string(""));
+	pn.param("checkpoint_tolerance", checkpoint_tolerance, 20);
+	pn.param("checkpoint_max_age", checkpoint_max_age, 600.0);
+	OdometryCheckpoint* checkpoint=NULL;
+	if(!checkpoint_file.empty()){
+		checkpoint=new OdometryCheckpoint(checkpoint_file);
+	}
+
 	tf::TransformBroadcaster odom_broadcaster;
 
 	ros::Publisher pub_odo= n.advertise<nav_msgs::Odometry >("/roomba/odometry", 100);
 
-	ros::Rate loop_rate(10); // should not set this rate more than 20Hz !
+	// loop_rate>0 fixes the rate, otherwise it follows what the link and
+	// the cycle work allow
+	double fixed_rate;
+	pn.param("loop_rate", fixed_rate, 0.0);
+	double min_period=AdaptiveRate::minPeriod(baud, 2, ALL_PACKET_SIZE, COMMAND_WAIT);
+	AdaptiveRate loop_rate(fixed_rate>0 ? std::max(1.0/fixed_rate, min_period) : min_period);
+	if(fixed_rate>0) ROS_INFO("loop rate fixed at %.1f Hz", loop_rate.rate());
+	else ROS_INFO("loop rate adaptive, at most %.1f Hz", loop_rate.rate());
+	unsigned long reported_overruns=0;
+
+	// spans of the cycle stages, see trace.h
+	std::string trace_file;
+	pn.param("trace_file", trace_file, std::string(""));
+	if(!trace_file.empty()){
+#ifdef ROOMBA_ENABLE_TRACE
+		Trace::start(trace_file);
+#else
+		ROS_WARN("built without ROOMBA_ENABLE_TRACE, ~trace_file is ignored");
+		trace_file.clear();
+#endif
+	}
 
 	geometry_msgs::Pose2D pose;
 	pose.x=0;	pose.y=0;	pose.theta=0;
@@ -192,23 +382,59 @@ int main(int argc, char** argv) {
 	last_time = ros::Time::now();
 
 	while (ros::ok()) {
+		ROOMBA_TRACE_SCOPE("cycle");
 		current_time = ros::Time::now();
 
 		roomba_500driver_meiji::Roomba500State sens;
 		sens.header.stamp=ros::Time::now();
 
+		// cntl_mutex_ is not held while the packet arrives, so a trajectory
+		// segment switch does not wait for the receive
+		{
+		ROOMBA_TRACE_SCOPE("get_sensors");
+		int requested;
 		{
-		boost::mutex::scoped_lock(cntl_mutex_);
-		roomba->getSensors(sens);
+		boost::mutex::scoped_lock lock(cntl_mutex_);
+		if(!roomba->connected()){
+			ROOMBA_TRACE_SCOPE("reconnect");
+			roomba->reconnect();
+		}
+		requested=roomba->requestSensors();
+		}
+		if(requested>=0){
+			int nbyte=roomba->receiveSensors();
+			boost::mutex::scoped_lock lock(cntl_mutex_);
+			roomba->decodeSensors(sens, nbyte);
+			lock.unlock();
+			Timer::sleepUntil(Timer::now()+COMMAND_WAIT);
+		}
+		}
+
+		// the robot has to report the counts of the checkpoint, otherwise
+		// it was moved or power cycled while the node was down
+		if(checkpoint && first_frame && roomba->validFrame()){
+			OdometryCheckpoint::Record rec;
+			if(checkpoint->load(rec) && OdometryCheckpoint::matches(rec, sens.encoder_counts.left,
+				sens.encoder_counts.right, checkpoint_tolerance, checkpoint_max_age, current_time.toSec())){
+				checkpoint->restore(rec);
+				pose.x=rec.x;	pose.y=rec.y;	pose.theta=rec.theta;
+				roomba->setEncoderBaseline(rec.encoder_left, rec.encoder_right);
+				ROS_INFO("odometry restored from %s: x:%f\ty:%f\ttheta:%f, %.1f sec old",
+					checkpoint_file.c_str(), pose.x, pose.y, pose.theta/M_PI*180.0, current_time.toSec()-rec.stamp);
+			}else{
+				ROS_INFO("no matching checkpoint in %s, odometry starts at 0", checkpoint_file.c_str());
+			}
 		}
 		//printSensors(sens);
 
-		int enc_r=roomba->dEncoderRight();
-		if(abs(enc_r)==200){
+		// the first frame after a reconnect carries the whole outage
+		bool resynced=roomba->encoderResynced();
+		int enc_r=roomba->dEncoderRight(resynced ? ENCODER_RESYNC_MAX : 200);
+		if(abs(enc_r)==200 && !resynced){
 			enc_r=pre_enc_r;
 		}
-		int enc_l=roomba->dEncoderLeft();
-		if(abs(enc_l)==200){
+		int enc_l=roomba->dEncoderLeft(resynced ? ENCODER_RESYNC_MAX : 200);
+		if(abs(enc_l)==200 && !resynced){
 			enc_l=pre_enc_l;
 		}
 
@@ -220,12 +446,98 @@ int main(int argc, char** argv) {
 		sens.distance=(short)(1000*distance);
 		sens.angle=(short)(angle*180.0/M_PI);
 
-		pub_state.publish(sens);
+		{
+		ROOMBA_TRACE_SCOPE("publish_states");
+		if(pub_state.getNumSubscribers()>0){
+			pub_state.publish(sens);
+		}
+		if(state_topics){
+			state_topics->publish(sens);
+		}
+		}
+
+		if(roomba->validFrame()){
+			if(first_frame){
+				first_frame=false;
+				ROS_INFO("time to first valid frame: %.3f sec", Timer::now()-start_time);
+			}
+
+			if(use_raw_frames && pub_raw.getNumSubscribers()>0){
+				ROOMBA_TRACE_SCOPE("publish_raw_frame");
+				RawFrameView::fill(raw_frame, sens.header.stamp, roomba->rawPacket());
+				pub_raw.publish(raw_frame);
+			}
+
+			{
+			ROOMBA_TRACE_SCOPE("publish_events");
+			roomba_500driver_meiji::SensorEvent event;
+			if(sensor_events.update(sens, event)){
+				pub_event.publish(event);
+			}
+			}
+			{
+			ROOMBA_TRACE_SCOPE("publish_telemetry");
+			telemetry.update(sens);
+			}
+			{
+			ROOMBA_TRACE_SCOPE("slip");
+			slip.update(sens, enc_l, enc_r);
+			}
+			{
+			boost::mutex::scoped_lock lock(cntl_mutex_);
+			if(dock_controller->active()){
+				ROOMBA_TRACE_SCOPE("dock_controller");
+				dock_controller->update(sens);
+			}
+			}
+			if(light_bumper_scan){
+				ROOMBA_TRACE_SCOPE("publish_light_bumper_scan");
+				light_bumper_scan->publish(sens);
+			}
+		}else{
+			slip.reset();
+		}
 
 		calcOdometry(pose, pre, distance, angle);
+		trajectory_executor->addOdometry(distance, angle);
+
+		// the robot keeps running the last command, so it is checked
+		// again from every new pose
+		// the trajectory thread sends through the same filter
+		if(geofence){
+			boost::mutex::scoped_lock lock(cntl_mutex_);
+			float fence_v, fence_w;
+			if(geofence->update(pose.x, pose.y, pose.theta, fence_v, fence_w)){
+				ROOMBA_TRACE_SCOPE("geofence");
+				roomba->driveDirect(fence_v, fence_w);
+			}
+		}
+		if(coverage){
+			ROOMBA_TRACE_SCOPE("coverage");
+			coverage->update(pose.x, pose.y, current_time);
+		}
 
-		pre_enc_r=roomba->dEncoderRight();
-		pre_enc_l=roomba->dEncoderLeft();
+		if(checkpoint && roomba->validFrame()){
+			ROOMBA_TRACE_SCOPE("checkpoint");
+			checkpoint->save(pose, enc_l, enc_r, sens.encoder_counts.left, sens.encoder_counts.right, current_time.toSec());
+		}
+		if(history && roomba->validFrame()){
+			ROOMBA_TRACE_SCOPE("history");
+			history->add(sens, roomba->rawPacket(), pose, roombactrl.cntl);
+		}
+		if(shared_state){
+			ROOMBA_TRACE_SCOPE("shared_state");
+			if(roomba->validFrame()){
+				shared_state->publish(sens, true, pose, roombactrl.cntl);
+			}else{
+				shared_state->setConnected(roomba->connected());
+			}
+		}
+
+		if(!resynced){
+			pre_enc_r=roomba->dEncoderRight();
+			pre_enc_l=roomba->dEncoderLeft();
+		}
 
 		//since all odometry is 6DOF we'll need a quaternion created from yaw
 		//ROSのOdometryには，6DOFを利用するのでyaw角から生成したquaternionを用いる
@@ -243,7 +555,10 @@ int main(int argc, char** argv) {
 		odom_trans.transform.rotation = odom_quat;
 
 		//send the transform
+		{
+		ROOMBA_TRACE_SCOPE("publish_tf");
 		odom_broadcaster.sendTransform(odom_trans);
+		}
 
 		//next, we'll publish the odometry message over ROS
 		nav_msgs::Odometry odom;
@@ -262,20 +577,71 @@ int main(int argc, char** argv) {
 		odom.twist.twist.linear.y = 0;
 		odom.twist.twist.angular.z = roombactrl.cntl.angular.z;
 
+		// x, y, z, roll, pitch, yaw; unused axes get a large variance
+		double cov_scale=slip.covarianceScale();
+		odom.pose.covariance[0] = odom.pose.covariance[7] = cov_xy*cov_scale;
+		odom.pose.covariance[14] = odom.pose.covariance[21] = odom.pose.covariance[28] = 1e6;
+		odom.pose.covariance[35] = cov_yaw*cov_scale;
+		odom.twist.covariance[0] = odom.twist.covariance[7] = cov_vx*cov_scale;
+		odom.twist.covariance[14] = odom.twist.covariance[21] = odom.twist.covariance[28] = 1e6;
+		odom.twist.covariance[35] = cov_wz*cov_scale;
 
+		{
+		ROOMBA_TRACE_SCOPE("publish_odometry");
 		pub_odo.publish(odom);
+		}
+		if(first_odometry && !first_frame){
+			first_odometry=false;
+			ROS_INFO("time to first odometry: %.3f sec", Timer::now()-start_time);
+		}
 
 		last_time = current_time;
 
+		{
+		ROOMBA_TRACE_SCOPE("spin");
 		ros::spinOnce();
+		arbiter.update();
+		}
+		{
+		ROOMBA_TRACE_SCOPE("loop_sleep");
 		loop_rate.sleep();
-		ROS_INFO("dt:%f\t444444444l: %5d\tr:%5d\tdl %4d\tdr %4d\tx:%f\ty:%f\ttheta:%f", last_time.toSec()-current_time.toSec(), sens.encoder_counts.left, sens.encoder_counts.right,  roomba->dEncoderLeft(), roomba->dEncoderRight(), pose.x,pose.y,pose.theta/M_PI*180.0);
+		}
+		if(loop_rate.overruns()!=reported_overruns){
+			reported_overruns=loop_rate.overruns();
+			ROS_WARN_THROTTLE(5.0, "loop overruns: %lu of %lu cycles, rate %.1f Hz, work %.1f ms",
+				reported_overruns, loop_rate.cycles(), loop_rate.rate(), loop_rate.workTime()*1000);
+		}
+		ROS_DEBUG("dt:%f\tl: %5d\tr:%5d\tdl %4d\tdr %4d\tx:%f\ty:%f\ttheta:%f", last_time.toSec()-current_time.toSec(), sens.encoder_counts.left, sens.encoder_counts.right,  roomba->dEncoderLeft(), roomba->dEncoderRight(), pose.x,pose.y,pose.theta/M_PI*180.0);
 	}
 
+	// no trajectory may write after the power off
+	delete trajectory_executor;
+
+	// powerOff() waits until the opcode is sent
 	roomba->powerOff();
 
-	roomba->time_->sleep(1);
+	if(!trace_file.empty()){
+		if(Trace::stop()){
+			ROS_INFO("trace written to %s", trace_file.c_str());
+		}else{
+			ROS_ERROR("cannot write trace to %s", trace_file.c_str());
+		}
+	}
 
+	if(geofence){
+		ROS_INFO("geofence check: mean %.1f usec, max %.1f usec",
+			geofence->meanCheckTime()*1e6, geofence->maxCheckTime()*1e6);
+	}
+	// the filter refers to the geofence
+	roomba->setDriveFilter(roombaSci::DriveFilter());
+	delete geofence;
+	delete dock_controller;
+	delete checkpoint;
+	delete history;
+	delete coverage;
+	delete shared_state;
+	delete light_bumper_scan;
+	delete state_topics;
 	delete roomba;
 
 	return 0;
@@ -0,0 +1,60 @@
+//---------------------------< /-/ AMSL /-/ >------------------------------
+/**
+ * file         :       adaptive_rate.cpp
+ *
+ *
+ * Environment  :       g++
+ *
+ */
+//-----------------------------------------------------------------------------
+
+#include "roomba_500driver_meiji/adaptive_rate.h"
+#include "roomba_500driver_meiji/timer.h"
+
+#include <algorithm>
+
+static const double HEADROOM=1.1;		// keep the period this much above the work time
+static const double SLOW_DOWN=1.25;		// period factor after an overrun
+static const double SPEED_UP=0.98;		// period factor after calm cycles
+static const int CALM_CYCLES=20;		// cycles without overrun before speeding up
+static const double WORK_GAIN=0.1;		// smoothing of the work time
+
+double AdaptiveRate::minPeriod(int bps, int request_bytes, int response_bytes, double wait)
+{
+	// 8N1: start + 8 data + stop bits per byte
+	double link=(request_bytes+response_bytes)*10.0/bps;
+	return std::max(link+wait, (double)OI_UPDATE_PERIOD);
+}
+
+AdaptiveRate::AdaptiveRate(double min_period, double max_period)
+:min_period_(min_period),max_period_(std::max(min_period, max_period)),
+period_(min_period),work_(0),calm_cycles_(0),
+overruns_(0),cycles_(0){
+	cycle_start_=Timer::now();
+}
+
+void AdaptiveRate::sleep()
+{
+	double now=Timer::now();
+	double work=now-cycle_start_;
+	work_+=WORK_GAIN*(work-work_);
+	cycles_++;
+
+	if(work>period_){
+		overruns_++;
+		calm_cycles_=0;
+		period_=std::min(max_period_, std::max(period_*SLOW_DOWN, work*HEADROOM));
+	}else if(++calm_cycles_>=CALM_CYCLES){
+		calm_cycles_=0;
+		period_=std::max(min_period_, std::max(period_*SPEED_UP, work_*HEADROOM));
+	}
+
+	double end=cycle_start_+period_;
+	if(end>now){
+		Timer().sleep(end-now);
+		cycle_start_=end;
+	}else{
+		// overran, start the next cycle now instead of catching up
+		cycle_start_=now;
+	}
+}
@@ -0,0 +1,261 @@
+//---------------------------< /-/ AMSL /-/ >------------------------------
+/**
+ * file         :       bulk_decoder.cpp
+ *
+ *
+ * Environment  :       g++
+ *
+ */
+//-----------------------------------------------------------------------------
+
+#include "roomba_500driver_meiji/bulk_decoder.h"
+#include "roomba_500driver_meiji/oi_packet.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <cmath>
+
+struct FieldSpec {
+	const char* name;
+	int offset;
+	BulkDecoder::TYPE type;
+};
+
+static const FieldSpec FIELDS[]={
+	{"bumps_wheeldrops",			OFS_BUMPS_WHEELDROPS,				BulkDecoder::T_U8},
+	{"wall",						OFS_WALL,							BulkDecoder::T_U8},
+	{"cliff_left",					OFS_CLIFF_LEFT,						BulkDecoder::T_U8},
+	{"cliff_front_left",			OFS_CLIFF_FRONT_LEFT,				BulkDecoder::T_U8},
+	{"cliff_front_right",			OFS_CLIFF_FRONT_RIGHT,				BulkDecoder::T_U8},
+	{"cliff_right",					OFS_CLIFF_RIGHT,					BulkDecoder::T_U8},
+	{"virtual_wall",				OFS_VIRTUAL_WALL,					BulkDecoder::T_U8},
+	{"overcurrents",				OFS_OVERCURRENTS,					BulkDecoder::T_U8},
+	{"dirt_detect",					OFS_DIRT_DETECT,					BulkDecoder::T_U8},
+	{"ir_omni",						OFS_IR_OMNI,						BulkDecoder::T_U8},
+	{"buttons",						OFS_BUTTONS,						BulkDecoder::T_U8},
+	{"distance",					OFS_DISTANCE,						BulkDecoder::T_S16},
+	{"angle",						OFS_ANGLE,							BulkDecoder::T_S16},
+	{"charging_state",				OFS_CHARGING_STATE,					BulkDecoder::T_U8},
+	{"voltage",						OFS_VOLTAGE,						BulkDecoder::T_U16},
+	{"current",						OFS_CURRENT,						BulkDecoder::T_S16},
+	{"temperature",					OFS_TEMPERATURE,					BulkDecoder::T_U8},
+	{"charge",						OFS_CHARGE,							BulkDecoder::T_U16},
+	{"capacity",					OFS_CAPACITY,						BulkDecoder::T_U16},
+	{"wall_signal",					OFS_WALL_SIGNAL,					BulkDecoder::T_U16},
+	{"cliff_left_signal",			OFS_CLIFF_LEFT_SIGNAL,				BulkDecoder::T_U16},
+	{"cliff_front_left_signal",		OFS_CLIFF_FRONT_LEFT_SIGNAL,		BulkDecoder::T_U16},
+	{"cliff_front_right_signal",	OFS_CLIFF_FRONT_RIGHT_SIGNAL,		BulkDecoder::T_U16},
+	{"cliff_right_signal",			OFS_CLIFF_RIGHT_SIGNAL,				BulkDecoder::T_U16},
+	{"charger_available",			OFS_CHARGER_AVAILABLE,				BulkDecoder::T_U8},
+	{"oi_mode",						OFS_OI_MODE,						BulkDecoder::T_U8},
+	{"song_number",					OFS_SONG_NUMBER,					BulkDecoder::T_U8},
+	{"song_playing",				OFS_SONG_PLAYING,					BulkDecoder::T_U8},
+	{"stream_packets",				OFS_STREAM_PACKETS,					BulkDecoder::T_U8},
+	{"requested_velocity",			OFS_REQUESTED_VELOCITY,				BulkDecoder::T_S16},
+	{"requested_radius",			OFS_REQUESTED_RADIUS,				BulkDecoder::T_S16},
+	{"requested_right_velocity",	OFS_REQUESTED_RIGHT_VELOCITY,		BulkDecoder::T_S16},
+	{"requested_left_velocity",		OFS_REQUESTED_LEFT_VELOCITY,		BulkDecoder::T_S16},
+	{"encoder_left",				OFS_ENCODER_LEFT,					BulkDecoder::T_U16},
+	{"encoder_right",				OFS_ENCODER_RIGHT,					BulkDecoder::T_U16},
+	{"light_bumper",				OFS_LIGHT_BUMPER,					BulkDecoder::T_U8},
+	{"light_bump_left_signal",			OFS_LIGHT_BUMP_LEFT_SIGNAL,			BulkDecoder::T_U16},
+	{"light_bump_front_left_signal",	OFS_LIGHT_BUMP_FRONT_LEFT_SIGNAL,	BulkDecoder::T_U16},
+	{"light_bump_center_left_signal",	OFS_LIGHT_BUMP_CENTER_LEFT_SIGNAL,	BulkDecoder::T_U16},
+	{"light_bump_center_right_signal",	OFS_LIGHT_BUMP_CENTER_RIGHT_SIGNAL,	BulkDecoder::T_U16},
+	{"light_bump_front_right_signal",	OFS_LIGHT_BUMP_FRONT_RIGHT_SIGNAL,	BulkDecoder::T_U16},
+	{"light_bump_right_signal",			OFS_LIGHT_BUMP_RIGHT_SIGNAL,		BulkDecoder::T_U16},
+	{"ir_left",						OFS_IR_LEFT,						BulkDecoder::T_U8},
+	{"ir_right",					OFS_IR_RIGHT,						BulkDecoder::T_U8},
+	{"left_motor_current",			OFS_LEFT_MOTOR_CURRENT,				BulkDecoder::T_S16},
+	{"right_motor_current",			OFS_RIGHT_MOTOR_CURRENT,			BulkDecoder::T_S16},
+	{"main_brush_current",			OFS_MAIN_BRUSH_CURRENT,				BulkDecoder::T_S16},
+	{"side_brush_current",			OFS_SIDE_BRUSH_CURRENT,				BulkDecoder::T_S16},
+	{"stasis",						OFS_STASIS,							BulkDecoder::T_U8}
+};
+static const int NUM_FIELDS=sizeof(FIELDS)/sizeof(FIELDS[0]);
+
+// frames decoded per pass over the columns. keeps the source block in cache
+static const size_t BLOCK_FRAMES=1024;
+
+// same constants as the odometry of the driver node
+static const double TICKS_PER_METER=2270.0;
+static const double WHEEL_BASE=0.235;	// m
+static const int MAX_DELTA=200;			// ticks, larger deltas are glitches
+
+size_t BulkDecoder::Column::elementSize() const
+{
+	switch(type){
+		case T_U8:	return 1;
+		case T_U16:
+		case T_S16:	return 2;
+		case T_S32:	return 4;
+		case T_F64:	return 8;
+	}
+	return 0;
+}
+
+BulkDecoder::Column* BulkDecoder::Columns::find(const std::string& name)
+{
+	for(size_t i=0; i<columns.size(); i++){
+		if(columns[i].name==name){
+			return &columns[i];
+		}
+	}
+	return NULL;
+}
+
+BulkDecoder::Column& BulkDecoder::Columns::add(const std::string& name, TYPE type)
+{
+	Column* c=find(name);
+	if(!c){
+		columns.push_back(Column());
+		c=&columns.back();
+		c->name=name;
+	}
+	c->type=type;
+	c->bytes.assign(frames*c->elementSize(), 0);
+	return *c;
+}
+
+static inline uint16_t loadBe16(const unsigned char* p)
+{
+	uint16_t v;
+	memcpy(&v, p, 2);
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	v=__builtin_bswap16(v);
+#endif
+	return v;
+}
+
+void BulkDecoder::decode(const unsigned char* data, size_t frames, Columns& out)
+{
+	out.frames=frames;
+	out.columns.clear();
+	out.columns.reserve(NUM_FIELDS+5);	// room for the derived columns
+
+	std::vector<unsigned char*> dst(NUM_FIELDS);
+	for(int f=0; f<NUM_FIELDS; f++){
+		dst[f]=out.add(FIELDS[f].name, FIELDS[f].type).as<unsigned char>();
+	}
+
+	for(size_t begin=0; begin<frames; begin+=BLOCK_FRAMES){
+		size_t end=std::min(frames, begin+BLOCK_FRAMES);
+
+		for(int f=0; f<NUM_FIELDS; f++){
+			const unsigned char* src=data+begin*ALL_PACKET_SIZE+FIELDS[f].offset;
+
+			if(FIELDS[f].type==T_U8){
+				unsigned char* d=dst[f]+begin;
+				for(size_t i=0; i<end-begin; i++){
+					d[i]=src[i*ALL_PACKET_SIZE];
+				}
+			}else{
+				// signed and unsigned share the bit pattern
+				uint16_t* d=reinterpret_cast<uint16_t*>(dst[f])+begin;
+				for(size_t i=0; i<end-begin; i++){
+					d[i]=loadBe16(src+i*ALL_PACKET_SIZE);
+				}
+			}
+		}
+	}
+}
+
+void BulkDecoder::unwrapEncoders(Columns& cols)
+{
+	const char* names[2][2]={
+		{"encoder_left", "d_encoder_left"},
+		{"encoder_right", "d_encoder_right"}
+	};
+
+	for(int w=0; w<2; w++){
+		Column& d=cols.add(names[w][1], T_S32);
+		const uint16_t* enc=cols.find(names[w][0])->as<uint16_t>();
+		int32_t* delta=d.as<int32_t>();
+
+		// the counters are 16 bit, so the wrapped difference is exact
+		for(size_t i=1; i<cols.frames; i++){
+			delta[i]=(int16_t)(uint16_t)(enc[i]-enc[i-1]);
+		}
+	}
+}
+
+void BulkDecoder::integrateOdometry(Columns& cols)
+{
+	cols.add("x", T_F64);
+	cols.add("y", T_F64);
+	cols.add("theta", T_F64);
+
+	const int32_t* dl=cols.find("d_encoder_left")->as<int32_t>();
+	const int32_t* dr=cols.find("d_encoder_right")->as<int32_t>();
+	double* x=cols.find("x")->as<double>();
+	double* y=cols.find("y")->as<double>();
+	double* theta=cols.find("theta")->as<double>();
+
+	double px=0, py=0, pth=0;
+	int pre_l=0, pre_r=0;
+	for(size_t i=0; i<cols.frames; i++){
+		int l=std::max(-MAX_DELTA, std::min(MAX_DELTA, (int)dl[i]));
+		int r=std::max(-MAX_DELTA, std::min(MAX_DELTA, (int)dr[i]));
+		if(std::abs(l)==MAX_DELTA) l=pre_l;
+		if(std::abs(r)==MAX_DELTA) r=pre_r;
+		pre_l=l;
+		pre_r=r;
+
+		double dist=(r+l)/TICKS_PER_METER*0.5;
+		double ang=(r-l)/TICKS_PER_METER/WHEEL_BASE;
+
+		pth+=ang;
+		if(pth>M_PI) pth-=2.0*M_PI;
+		if(pth<-M_PI) pth+=2.0*M_PI;
+		px+=dist*cos(pth);
+		py+=dist*sin(pth);
+
+		x[i]=px;
+		y[i]=py;
+		theta[i]=pth;
+	}
+}
+
+bool BulkDecoder::write(const Columns& cols, const char* path)
+{
+	FILE* fp=fopen(path, "wb");
+	if(!fp){
+		perror("bulk decoder: Unable to open output ");
+		return false;
+	}
+
+	uint64_t frames=cols.frames;
+	uint32_t ncol=cols.columns.size();
+	fwrite("ROICOL01", 1, 8, fp);
+	fwrite(&frames, sizeof(frames), 1, fp);
+	fwrite(&ncol, sizeof(ncol), 1, fp);
+
+	uint64_t offset=8+sizeof(frames)+sizeof(ncol)+ncol*(32+sizeof(uint32_t)+sizeof(uint64_t));
+	for(size_t i=0; i<cols.columns.size(); i++){
+		const Column& c=cols.columns[i];
+		char name[32];
+		memset(name, 0, sizeof(name));
+		strncpy(name, c.name.c_str(), sizeof(name)-1);
+		uint32_t type=c.type;
+
+		fwrite(name, 1, sizeof(name), fp);
+		fwrite(&type, sizeof(type), 1, fp);
+		fwrite(&offset, sizeof(offset), 1, fp);
+		offset+=c.bytes.size();
+	}
+
+	for(size_t i=0; i<cols.columns.size(); i++){
+		const Column& c=cols.columns[i];
+		if(!c.bytes.empty()){
+			fwrite(&c.bytes[0], 1, c.bytes.size(), fp);
+		}
+	}
+
+	bool ok=!ferror(fp);
+	if(fclose(fp)!=0){
+		ok=false;
+	}
+	return ok;
+}
@@ -0,0 +1,194 @@
+//---------------------------< /-/ AMSL /-/ >------------------------------
+/**
+ * file         :       command_arbiter.cpp
+ *
+ *
+ * Environment  :       g++
+ *
+ */
+//-----------------------------------------------------------------------------
+
+#include "roomba_500driver_meiji/command_arbiter.h"
+#include "roomba_500driver_meiji/timer.h"
+
+#include <std_msgs/String.h>
+#include <boost/bind.hpp>
+
+using namespace roomba_500driver_meiji;
+
+CommandArbiter::CommandArbiter(ros::NodeHandle& n, ros::NodeHandle& pn, Executor execute, Stopper stop,
+	const ros::TransportHints& hints)
+:execute_(execute),stop_(stop),active_(-1){
+	std::vector<std::string> names;
+	pn.getParam("sources", names);
+
+	for(size_t i=0; i<names.size(); i++){
+		std::string ns="source/"+names[i]+"/";
+		std::string topic, type;
+		int priority, queue;
+		double timeout;
+		pn.param(ns+"topic", topic, names[i]);
+		pn.param(ns+"type", type, std::string("control"));
+		pn.param(ns+"priority", priority, 0);
+		pn.param(ns+"timeout", timeout, COMMAND_DEFAULT_TIMEOUT);
+		pn.param(ns+"queue", queue, 10);
+		if(type!="control" && type!="twist"){
+			ROS_WARN("command source %s: unknown type %s, using control", names[i].c_str(), type.c_str());
+		}
+		// a source that never expires would lock out every lower priority
+		// source after its last command
+		if(!(timeout>0)){
+			ROS_WARN("command source %s: timeout must be positive, using %.2f sec",
+				names[i].c_str(), COMMAND_DEFAULT_TIMEOUT);
+			timeout=COMMAND_DEFAULT_TIMEOUT;
+		}
+		addSource(names[i], topic, type=="twist" ? ST_TWIST : ST_CONTROL, priority, timeout, queue);
+	}
+
+	// without configuration both inputs have the same priority and never
+	// expire, which is what the driver always did: the last command wins
+	if(sources_.empty()){
+		addSource("control", "/roomba/control", ST_CONTROL, 0, 0.0, 100);
+		addSource("cmd_vel", "cmd_vel", ST_TWIST, 0, 0.0, 1);
+	}
+
+	// subscribe after the vector is complete, the callbacks refer to indices
+	for(size_t i=0; i<sources_.size(); i++){
+		subscribe(n, i, hints);
+		ROS_INFO("command source %s: %s priority %d timeout %.2f sec",
+			sources_[i].name.c_str(), sources_[i].topic.c_str(), sources_[i].priority, sources_[i].timeout);
+	}
+
+	pub_active_=n.advertise<std_msgs::String>("/roomba/active_source", 1, true);
+	setActive(-1);
+}
+
+void CommandArbiter::addSource(const std::string& name, const std::string& topic, SOURCE_TYPE type,
+	int priority, double timeout, int queue)
+{
+	Source s;
+	s.name=name;
+	s.topic=topic;
+	s.type=type;
+	s.priority=priority;
+	s.timeout=timeout;
+	s.queue=queue;
+	s.last=0;
+	s.pending=false;
+	s.driving=false;
+	sources_.push_back(s);
+}
+
+void CommandArbiter::subscribe(ros::NodeHandle& n, int index, const ros::TransportHints& hints)
+{
+	Source& s=sources_[index];
+	if(s.type==ST_TWIST){
+		s.sub=n.subscribe<geometry_msgs::Twist>(s.topic, s.queue,
+			boost::bind(&CommandArbiter::twistCallback, this, _1, index), ros::VoidConstPtr(), hints);
+	}else{
+		s.sub=n.subscribe<RoombaCtrl>(s.topic, s.queue,
+			boost::bind(&CommandArbiter::controlCallback, this, _1, index), ros::VoidConstPtr(), hints);
+	}
+}
+
+void CommandArbiter::controlCallback(const RoombaCtrlConstPtr& msg, int index)
+{
+	submit(index, *msg);
+}
+
+void CommandArbiter::twistCallback(const geometry_msgs::TwistConstPtr& msg, int index)
+{
+	RoombaCtrl cmd;
+	cmd.mode=RoombaCtrl::DRIVE_DIRECT;
+	cmd.cntl=*msg;
+	submit(index, cmd);
+}
+
+void CommandArbiter::submit(int index, const RoombaCtrl& cmd)
+{
+	double now=Timer::now();
+	if(!accept(index, now)){
+		ROS_DEBUG("command from %s dropped, %s is active",
+			sources_[index].name.c_str(), sources_[active_].name.c_str());
+		return;
+	}
+
+	Source& s=sources_[index];
+	s.last=now;
+	// a new source takes over, whatever others left behind is stale
+	if(index!=active_){
+		for(size_t i=0; i<sources_.size(); i++){
+			sources_[i].pending=false;
+		}
+		setActive(index);
+	}
+
+	s.driving=isDrive(cmd.mode);
+	if(s.driving){
+		s.cmd=cmd;
+		s.pending=true;
+	}else{
+		// keep the order of a drive command followed by a mode change
+		flush();
+		execute_(cmd);
+	}
+}
+
+bool CommandArbiter::accept(int index, double now)
+{
+	if(active_<0 || active_==index){
+		return true;
+	}
+	if(sources_[index].priority>=sources_[active_].priority){
+		return true;
+	}
+	return expired(active_, now);
+}
+
+bool CommandArbiter::expired(int index, double now) const
+{
+	const Source& s=sources_[index];
+	return s.timeout>0 && now-s.last>s.timeout;
+}
+
+void CommandArbiter::update()
+{
+	flush();
+
+	if(active_>=0 && expired(active_, Timer::now())){
+		// a mode change, docking or a trajectory keeps running
+		if(sources_[active_].driving){
+			ROS_WARN("command source %s timed out, stopping", sources_[active_].name.c_str());
+			stop_();
+		}else{
+			ROS_INFO("command source %s timed out", sources_[active_].name.c_str());
+		}
+		setActive(-1);
+	}
+}
+
+void CommandArbiter::flush()
+{
+	if(active_>=0 && sources_[active_].pending){
+		sources_[active_].pending=false;
+		execute_(sources_[active_].cmd);
+	}
+}
+
+void CommandArbiter::setActive(int index)
+{
+	active_=index;
+	std_msgs::String msg;
+	msg.data=active();
+	pub_active_.publish(msg);
+}
+
+std::string CommandArbiter::active() const
+{
+	return active_>=0 ? sources_[active_].name : std::string();
+}
+
+bool CommandArbiter::isDrive(int mode)
+{
+	return mode==RoombaCtrl::DRIVE || mode==RoombaCtrl::DRIVE_DIRECT || mode==RoombaCtrl::DRIVE_PWM;
+}
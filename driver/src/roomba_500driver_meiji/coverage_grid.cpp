@@ -0,0 +1,235 @@
+//---------------------------< /-/ AMSL /-/ >------------------------------
+/**
+ * file         :       coverage_grid.cpp
+ *
+ *
+ * Environment  :       g++
+ *
+ */
+//-----------------------------------------------------------------------------
+
+#include "roomba_500driver_meiji/coverage_grid.h"
+
+#include <map_msgs/OccupancyGridUpdate.h>
+
+#include <algorithm>
+#include <cmath>
+#include <string.h>
+
+static const int8_t CELL_UNKNOWN=-1;	// no tile allocated
+static const int8_t CELL_FREE=0;
+static const int8_t CELL_COVERED=100;
+
+CoverageGrid::CoverageGrid(ros::NodeHandle& n, ros::NodeHandle& pn)
+:ox_(0),oy_(0),w_(0),h_(0),pox_(0),poy_(0),pw_(0),ph_(0),resized_(false),
+	has_pose_(false),x_(0),y_(0){
+	double rate, grid_period;
+	pn.param("coverage_resolution", resolution_, 0.05);
+	pn.param("coverage_radius", radius_, 0.17);
+	pn.param("coverage_rate", rate, 1.0);
+	pn.param("coverage_grid_period", grid_period, 10.0);
+	pn.param("coverage_frame", frame_, std::string("odom"));
+	if(resolution_<=0){
+		resolution_=0.05;
+	}
+	if(rate<=0){
+		rate=1.0;
+	}
+	if(grid_period<0){
+		grid_period=0;
+	}
+	period_=ros::Duration(1.0/rate);
+	grid_period_=ros::Duration(grid_period);
+
+	pub_grid_=n.advertise<nav_msgs::OccupancyGrid>("/roomba/coverage", 1, true);
+	pub_update_=n.advertise<map_msgs::OccupancyGridUpdate>("/roomba/coverage_updates", 100);
+	srv_=n.advertiseService("/roomba/get_coverage", &CoverageGrid::getCoverage, this);
+}
+
+void CoverageGrid::update(double x, double y, const ros::Time& stamp)
+{
+	stamp_=stamp;
+	if(!has_pose_ || std::sqrt((x-x_)*(x-x_)+(y-y_)*(y-y_))>COVERAGE_MAX_STEP){
+		// first pose or a jump of the odometry: no path to sweep
+		sweep(x, y, x, y);
+	}else{
+		sweep(x_, y_, x, y);
+	}
+	has_pose_=true;
+	x_=x;
+	y_=y;
+
+	if(stamp-last_pub_ < period_){
+		return;
+	}
+	last_pub_=stamp;
+	publish(stamp);
+}
+
+// sets the cells whose centers are within radius_ of the segment
+void CoverageGrid::sweep(double x0, double y0, double x1, double y1)
+{
+	double dx=x1-x0, dy=y1-y0;
+	double len2=dx*dx+dy*dy;
+	double r2=radius_*radius_;
+
+	int cx_min=(int)std::floor((std::min(x0, x1)-radius_)/resolution_);
+	int cx_max=(int)std::floor((std::max(x0, x1)+radius_)/resolution_);
+	int cy_min=(int)std::floor((std::min(y0, y1)-radius_)/resolution_);
+	int cy_max=(int)std::floor((std::max(y0, y1)+radius_)/resolution_);
+
+	for(int cy=cy_min; cy<=cy_max; cy++){
+		double py=(cy+0.5)*resolution_;
+		// the swept disc is convex, so every row is one span
+		int first=cx_max+1, last=cx_min-1;
+		for(int cx=cx_min; cx<=cx_max; cx++){
+			double px=(cx+0.5)*resolution_;
+			double t=len2>0 ? ((px-x0)*dx+(py-y0)*dy)/len2 : 0;
+			t=std::max(0.0, std::min(1.0, t));
+			double ex=px-(x0+t*dx), ey=py-(y0+t*dy);
+			if(ex*ex+ey*ey<=r2){
+				first=std::min(first, cx);
+				last=cx;
+			}
+		}
+		if(first<=last){
+			setSpan(cy, first, last);
+		}
+	}
+}
+
+void CoverageGrid::setSpan(int cy, int cx0, int cx1)
+{
+	int ty=tileOf(cy);
+	int row=cy-ty*COVERAGE_TILE;
+	for(int tx=tileOf(cx0); tx<=tileOf(cx1); tx++){
+		int base=tx*COVERAGE_TILE;
+		int b0=std::max(cx0, base)-base;
+		int b1=std::min(cx1, base+COVERAGE_TILE-1)-base;
+		uint64_t mask=(b1-b0==63) ? ~(uint64_t)0 : ((((uint64_t)1)<<(b1-b0+1))-1)<<b0;
+
+		uint64_t k=key(tx, ty);
+		TileMap::iterator it=tiles_.find(k);
+		if(it==tiles_.end()){
+			Tile t;
+			memset(t.rows, 0, sizeof(t.rows));
+			it=tiles_.insert(std::make_pair(k, t)).first;
+			grow(tx, ty);
+		}
+		uint64_t& bits=it->second.rows[row];
+		if((bits|mask)!=bits){
+			bits|=mask;
+			dirty_.insert(k);
+		}
+	}
+}
+
+void CoverageGrid::grow(int tx, int ty)
+{
+	if(w_>0 && tx>=ox_ && tx<ox_+w_ && ty>=oy_ && ty<oy_+h_){
+		return;
+	}
+	int x0=tx-COVERAGE_GROW, x1=tx+COVERAGE_GROW;
+	int y0=ty-COVERAGE_GROW, y1=ty+COVERAGE_GROW;
+	if(w_>0){
+		// at least double towards the tile, every full grid costs the extent
+		x0=tx<ox_ ? std::min(x0, ox_-w_) : ox_;
+		x1=tx>=ox_+w_ ? std::max(x1, ox_+2*w_-1) : ox_+w_-1;
+		y0=ty<oy_ ? std::min(y0, oy_-h_) : oy_;
+		y1=ty>=oy_+h_ ? std::max(y1, oy_+2*h_-1) : oy_+h_-1;
+	}
+	ox_=x0;	oy_=y0;
+	w_=x1-x0+1;	h_=y1-y0+1;
+	resized_=true;
+}
+
+void CoverageGrid::publish(const ros::Time& stamp)
+{
+	if(resized_ && (last_grid_.isZero() || stamp-last_grid_>=grid_period_)){
+		// updates refer to the grid, so a new extent needs a full grid
+		nav_msgs::OccupancyGrid grid;
+		fill(grid);
+		pub_grid_.publish(grid);
+		pox_=ox_;	poy_=oy_;
+		pw_=w_;		ph_=h_;
+		resized_=false;
+		last_grid_=stamp;
+		dirty_.clear();
+		return;
+	}
+
+	bool send=pub_update_.getNumSubscribers()>0;
+	std::set<uint64_t>::iterator it=dirty_.begin();
+	while(it!=dirty_.end()){
+		if(!published(keyX(*it), keyY(*it))){
+			// outside the grid the subscribers have, goes with the next one
+			++it;
+			continue;
+		}
+		if(send){
+			map_msgs::OccupancyGridUpdate msg;
+			msg.header.stamp=stamp;
+			msg.header.frame_id=frame_;
+			msg.x=(keyX(*it)-pox_)*COVERAGE_TILE;
+			msg.y=(keyY(*it)-poy_)*COVERAGE_TILE;
+			msg.width=COVERAGE_TILE;
+			msg.height=COVERAGE_TILE;
+			msg.data.resize(COVERAGE_TILE*COVERAGE_TILE);
+			fillTile(msg.data, COVERAGE_TILE, 0, 0, &tiles_.find(*it)->second);
+			pub_update_.publish(msg);
+		}
+		dirty_.erase(it++);
+	}
+}
+
+bool CoverageGrid::published(int tx, int ty) const
+{
+	return tx>=pox_ && tx<pox_+pw_ && ty>=poy_ && ty<poy_+ph_;
+}
+
+void CoverageGrid::fill(nav_msgs::OccupancyGrid& grid) const
+{
+	grid.header.stamp=stamp_;
+	grid.header.frame_id=frame_;
+	grid.info.map_load_time=stamp_;
+	grid.info.resolution=resolution_;
+	grid.info.width=w_*COVERAGE_TILE;
+	grid.info.height=h_*COVERAGE_TILE;
+	grid.info.origin.position.x=ox_*COVERAGE_TILE*resolution_;
+	grid.info.origin.position.y=oy_*COVERAGE_TILE*resolution_;
+	grid.info.origin.orientation.w=1.0;
+	grid.data.assign(grid.info.width*grid.info.height, CELL_UNKNOWN);
+
+	for(TileMap::const_iterator it=tiles_.begin(); it!=tiles_.end(); ++it){
+		fillTile(grid.data, grid.info.width,
+			(keyX(it->first)-ox_)*COVERAGE_TILE, (keyY(it->first)-oy_)*COVERAGE_TILE, &it->second);
+	}
+}
+
+void CoverageGrid::fillTile(std::vector<int8_t>& data, int stride, int x, int y, const Tile* tile) const
+{
+	for(int j=0; j<COVERAGE_TILE; j++){
+		uint64_t bits=tile->rows[j];
+		int8_t* p=&data[(y+j)*stride+x];
+		for(int i=0; i<COVERAGE_TILE; i++){
+			p[i]=((bits>>i)&1) ? CELL_COVERED : CELL_FREE;
+		}
+	}
+}
+
+bool CoverageGrid::getCoverage(nav_msgs::GetMap::Request& req, nav_msgs::GetMap::Response& res)
+{
+	fill(res.map);
+	return true;
+}
+
+unsigned long CoverageGrid::coveredCells() const
+{
+	unsigned long n=0;
+	for(TileMap::const_iterator it=tiles_.begin(); it!=tiles_.end(); ++it){
+		for(int j=0; j<COVERAGE_TILE; j++){
+			n+=__builtin_popcountll(it->second.rows[j]);
+		}
+	}
+	return n;
+}
@@ -0,0 +1,188 @@
+//---------------------------< /-/ AMSL /-/ >------------------------------
+/**
+ * file         :       dock_controller.cpp
+ *
+ *
+ * Environment  :       g++
+ *
+ */
+//-----------------------------------------------------------------------------
+
+#include "roomba_500driver_meiji/dock_controller.h"
+#include "roomba_500driver_meiji/timer.h"
+
+using namespace roomba_500driver_meiji;
+
+static const char* STATE_NAMES[]={
+	"IDLE", "SEARCH", "APPROACH", "CONTACT", "BACKOFF", "DOCKED", "FALLBACK"
+};
+
+DockController::DockController(roombaSci* roomba, ros::NodeHandle& pn)
+:roomba_(roomba),state_(IDLE),start_(0),entered_(0),contacts_(0),
+last_v_(0),last_w_(0),turn_sign_(1){
+	pn.param("dock_speed", speed_, 0.15);
+	pn.param("dock_slow_speed", slow_speed_, 0.05);
+	pn.param("dock_turn", turn_, 0.6);
+	pn.param("dock_timeout", timeout_, 60.0);
+	pn.param("dock_contact_wait", contact_wait_, 2.0);
+	pn.param("dock_backoff_time", backoff_time_, 1.0);
+	pn.param("dock_max_contacts", max_contacts_, 3);
+	pn.param("dock_red_on_left", red_on_left_, true);
+}
+
+uint8_t DockController::dockBits(uint8_t code)
+{
+	if((code&IR_DOCK_MASK)==IR_DOCK){
+		return code&(IR_FORCE_FIELD|IR_GREEN_BUOY|IR_RED_BUOY);
+	}
+	// 255 is not a dock code
+	if((code&IR_DOCK_MASK)==IR_DOCK_600 && code!=0xff){
+		uint8_t bits=code&(IR_GREEN_BUOY|IR_RED_BUOY);
+		if(code&IR_FORCE_FIELD_600){
+			bits|=IR_FORCE_FIELD;
+		}
+		return bits;
+	}
+	return 0;
+}
+
+bool DockController::onCharger(const Roomba500State& sens)
+{
+	// bit 1 of packet 34 is the home base, charging states 1-4 need power
+	return (sens.charger_available&0x02) || (sens.charging_state>=1 && sens.charging_state<=4);
+}
+
+void DockController::start()
+{
+	start_=Timer::now();
+	contacts_=0;
+	last_v_=last_w_=1e9;	// forces the first command out
+	enter(SEARCH);
+}
+
+void DockController::cancel()
+{
+	if(active()){
+		ROS_INFO("docking cancelled in %s", STATE_NAMES[state_]);
+		state_=IDLE;
+	}
+}
+
+void DockController::enter(STATE s)
+{
+	ROS_DEBUG("docking: %s -> %s", STATE_NAMES[state_], STATE_NAMES[s]);
+	state_=s;
+	entered_=Timer::now();
+}
+
+void DockController::drive(float velocity, float yawrate)
+{
+	// the OI keeps the last command, so only changes are sent
+	if(velocity==last_v_ && yawrate==last_w_){
+		return;
+	}
+	last_v_=velocity;
+	last_w_=yawrate;
+	roomba_->driveDirect(velocity, yawrate);
+}
+
+void DockController::fallback(const char* reason)
+{
+	ROS_WARN("docking: %s after %.1f sec, falling back to the firmware seek", reason, Timer::now()-start_);
+	drive(0, 0);
+	roomba_->forceSeekingDock();
+	enter(FALLBACK);
+}
+
+void DockController::update(const Roomba500State& sens)
+{
+	if(!active()){
+		return;
+	}
+
+	double now=Timer::now();
+	if(onCharger(sens)){
+		drive(0, 0);
+		// the battery is not charged in SAFE or FULL
+		roomba_->passiveAsync();
+		ROS_INFO("docked in %.2f sec", now-start_);
+		enter(DOCKED);
+		return;
+	}
+	if(now-start_>timeout_){
+		fallback("timeout");
+		return;
+	}
+
+	uint8_t left=dockBits((uint8_t)sens.opcode.left);
+	uint8_t right=dockBits((uint8_t)sens.opcode.right);
+	uint8_t omni=dockBits(sens.remote_control_command);
+	uint8_t seen=left|right;
+	bool bumped=sens.bump.left || sens.bump.right;
+
+	switch(state_){
+		case SEARCH:
+			if(left || right){
+				enter(APPROACH);
+				break;
+			}
+			// the omni receiver alone only says the dock is around,
+			// turn slower then so the front receivers do not pass the beam
+			drive(0, turn_sign_*(omni ? 0.5*turn_ : turn_));
+			break;
+
+		case APPROACH:
+			if(bumped){
+				drive(0, 0);
+				enter(CONTACT);
+				break;
+			}
+			if(!left && !right){
+				enter(SEARCH);
+				drive(0, turn_sign_*turn_);
+				break;
+			}
+			{
+				float v=(seen&IR_FORCE_FIELD) ? slow_speed_ : speed_;
+				float w=0;
+				if(left && !right){
+					// only the left receiver sees the dock
+					turn_sign_=1;
+					w=0.5*turn_;
+					v=slow_speed_;
+				}else if(right && !left){
+					turn_sign_=-1;
+					w=-0.5*turn_;
+					v=slow_speed_;
+				}else if((seen&(IR_RED_BUOY|IR_GREEN_BUOY))==IR_RED_BUOY){
+					// off the center line on the red side, steer back to it
+					w=(red_on_left_ ? -0.3 : 0.3)*turn_;
+				}else if((seen&(IR_RED_BUOY|IR_GREEN_BUOY))==IR_GREEN_BUOY){
+					w=(red_on_left_ ? 0.3 : -0.3)*turn_;
+				}
+				drive(v, w);
+			}
+			break;
+
+		case CONTACT:
+			drive(0, 0);
+			if(now-entered_>=contact_wait_){
+				if(++contacts_>=max_contacts_){
+					fallback("no charger after contacts");
+				}else{
+					enter(BACKOFF);
+				}
+			}
+			break;
+
+		case BACKOFF:
+			drive(-slow_speed_, 0);
+			if(now-entered_>=backoff_time_){
+				enter(SEARCH);
+			}
+			break;
+
+		default:
+			break;
+	}
+}
@@ -0,0 +1,264 @@
+//---------------------------< /-/ AMSL /-/ >------------------------------
+/**
+ * file         :       geofence.cpp
+ *
+ *
+ * Environment  :       g++
+ *
+ */
+//-----------------------------------------------------------------------------
+
+#include "roomba_500driver_meiji/geofence.h"
+#include "roomba_500driver_meiji/timer.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+// tried in order when the full command is not clear
+static const float SCALES[]={1.0, 0.5, 0.25};
+static const int NUM_SCALES=sizeof(SCALES)/sizeof(SCALES[0]);
+
+static bool isFinite(float x){
+	return x==x && std::fabs(x)<=FLT_MAX;
+}
+
+Geofence::Geofence(ros::NodeHandle& pn)
+:cell_(0.5),origin_x_(0),origin_y_(0),cols_(0),rows_(0),
+x_(0),y_(0),theta_(0),velocity_(0),yawrate_(0),
+checks_(0),total_check_(0),max_check_(0){
+	pn.param("geofence_horizon", horizon_, 0.5);
+	pn.param("geofence_cell", cell_, 0.5);
+	pn.param("geofence_radius", radius_, 0.17);
+	if(radius_<0){
+		radius_=0;
+	}
+	if(cell_<=0){
+		cell_=0.5;
+	}
+
+	std::vector<std::string> names;
+	pn.getParam("keep_out", names);
+	for(size_t i=0; i<names.size(); i++){
+		std::vector<double> xy;
+		if(!pn.getParam("keep_out_zone/"+names[i], xy) || xy.size()<6 || xy.size()%2!=0){
+			ROS_WARN("keep out zone %s needs at least 3 x, y pairs", names[i].c_str());
+			continue;
+		}
+		Zone z;
+		z.name=names[i];
+		for(size_t k=0; k<xy.size(); k+=2){
+			z.x.push_back(xy[k]);
+			z.y.push_back(xy[k+1]);
+		}
+		z.min_x=*std::min_element(z.x.begin(), z.x.end());
+		z.max_x=*std::max_element(z.x.begin(), z.x.end());
+		z.min_y=*std::min_element(z.y.begin(), z.y.end());
+		z.max_y=*std::max_element(z.y.begin(), z.y.end());
+		zones_.push_back(z);
+		ROS_INFO("keep out zone %s: %d vertices", z.name.c_str(), (int)z.x.size());
+	}
+	buildIndex();
+}
+
+void Geofence::buildIndex()
+{
+	if(zones_.empty()){
+		return;
+	}
+	double min_x=zones_[0].min_x, max_x=zones_[0].max_x;
+	double min_y=zones_[0].min_y, max_y=zones_[0].max_y;
+	for(size_t i=1; i<zones_.size(); i++){
+		min_x=std::min(min_x, zones_[i].min_x);	max_x=std::max(max_x, zones_[i].max_x);
+		min_y=std::min(min_y, zones_[i].min_y);	max_y=std::max(max_y, zones_[i].max_y);
+	}
+	// a cell lists every zone within the footprint radius of it
+	min_x-=radius_;	max_x+=radius_;
+	min_y-=radius_;	max_y+=radius_;
+	origin_x_=min_x;
+	origin_y_=min_y;
+	cols_=(int)std::floor((max_x-min_x)/cell_)+1;
+	rows_=(int)std::floor((max_y-min_y)/cell_)+1;
+	cells_.assign(cols_*rows_, std::vector<int>());
+
+	for(size_t i=0; i<zones_.size(); i++){
+		const Zone& z=zones_[i];
+		int c0=(int)std::floor((z.min_x-radius_-origin_x_)/cell_);
+		int c1=(int)std::floor((z.max_x+radius_-origin_x_)/cell_);
+		int r0=(int)std::floor((z.min_y-radius_-origin_y_)/cell_);
+		int r1=(int)std::floor((z.max_y+radius_-origin_y_)/cell_);
+		for(int r=r0; r<=r1; r++){
+			for(int c=c0; c<=c1; c++){
+				cells_[r*cols_+c].push_back(i);
+			}
+		}
+	}
+}
+
+int Geofence::cellIndex(double x, double y) const
+{
+	int c=(int)std::floor((x-origin_x_)/cell_);
+	int r=(int)std::floor((y-origin_y_)/cell_);
+	if(c<0 || c>=cols_ || r<0 || r>=rows_){
+		return -1;
+	}
+	return r*cols_+c;
+}
+
+// even-odd rule
+bool Geofence::insideZone(const Zone& z, double x, double y) const
+{
+	if(x<z.min_x || x>z.max_x || y<z.min_y || y>z.max_y){
+		return false;
+	}
+	bool in=false;
+	size_t n=z.x.size();
+	for(size_t i=0, j=n-1; i<n; j=i++){
+		if((z.y[i]>y)!=(z.y[j]>y) &&
+			x<(z.x[j]-z.x[i])*(y-z.y[i])/(z.y[j]-z.y[i])+z.x[i]){
+			in=!in;
+		}
+	}
+	return in;
+}
+
+double Geofence::edgeDistance(const Zone& z, double x, double y)
+{
+	double best=DBL_MAX;
+	size_t n=z.x.size();
+	for(size_t i=0, j=n-1; i<n; j=i++){
+		double ex=z.x[i]-z.x[j], ey=z.y[i]-z.y[j];
+		double len2=ex*ex+ey*ey;
+		double t=(len2>0) ? ((x-z.x[j])*ex+(y-z.y[j])*ey)/len2 : 0;
+		t=std::max(0.0, std::min(1.0, t));
+		double dx=x-(z.x[j]+t*ex), dy=y-(z.y[j]+t*ey);
+		best=std::min(best, dx*dx+dy*dy);
+	}
+	return std::sqrt(best);
+}
+
+double Geofence::clearance(double x, double y) const
+{
+	// nothing within the radius outside the index
+	double far=radius_+cell_;
+	int cell=cellIndex(x, y);
+	if(cell<0){
+		return far;
+	}
+	double best=far;
+	const std::vector<int>& list=cells_[cell];
+	for(size_t i=0; i<list.size(); i++){
+		const Zone& z=zones_[list[i]];
+		double d=edgeDistance(z, x, y);
+		if(insideZone(z, x, y)){
+			d=-d;
+		}
+		best=std::min(best, d);
+	}
+	return best;
+}
+
+bool Geofence::inside(double x, double y) const
+{
+	return clearance(x, y)<radius_;
+}
+
+bool Geofence::clear(double x, double y, double theta, float velocity, float yawrate) const
+{
+	// no gap between samples the footprint could pass through
+	double step=std::max(0.5*radius_, 0.01);
+	int samples=(int)std::ceil(std::fabs(velocity)*horizon_/step);
+	samples=std::max(GEOFENCE_MIN_SAMPLES, std::min(GEOFENCE_MAX_SAMPLES, samples));
+	double dt=horizon_/samples;
+	for(int i=0; i<samples; i++){
+		// midpoint integration of the unicycle model
+		double th=theta+yawrate*dt*0.5;
+		x+=velocity*dt*std::cos(th);
+		y+=velocity*dt*std::sin(th);
+		theta+=yawrate*dt;
+		if(inside(x, y)){
+			return false;
+		}
+	}
+	return true;
+}
+
+void Geofence::limit(float& velocity, float& yawrate)
+{
+	double start=Timer::now();
+	float v=velocity, w=yawrate;
+
+	double now_clearance=clearance(x_, y_);
+	if(now_clearance<radius_){
+		// already touching a zone: only let the robot turn or move away
+		double th=theta_+w*horizon_*0.5;
+		if(clearance(x_+v*horizon_*std::cos(th), y_+v*horizon_*std::sin(th))<=now_clearance){
+			velocity=0;
+		}
+	}else{
+		int i=0;
+		while(i<NUM_SCALES && !clear(x_, y_, theta_, v*SCALES[i], w*SCALES[i])){
+			i++;
+		}
+		if(i<NUM_SCALES){
+			velocity=v*SCALES[i];
+			yawrate=w*SCALES[i];
+		}else{
+			velocity=0;
+			yawrate=0;
+		}
+	}
+
+	double used=Timer::now()-start;
+	checks_++;
+	total_check_+=used;
+	max_check_=std::max(max_check_, used);
+}
+
+void Geofence::filter(float& velocity, float& yawrate)
+{
+	if(zones_.empty()){
+		return;
+	}
+	boost::mutex::scoped_lock lock(mutex_);
+	if(!isFinite(velocity) || !isFinite(yawrate)){
+		ROS_WARN_THROTTLE(1.0, "geofence: invalid command stopped");
+		velocity=yawrate=0;
+	}
+	float v=velocity, w=yawrate;
+	limit(velocity, yawrate);
+	if(velocity!=v || yawrate!=w){
+		ROS_WARN_THROTTLE(1.0, "geofence: command %.2f m/s %.2f rad/s limited to %.2f m/s %.2f rad/s",
+			v, w, velocity, yawrate);
+	}
+	velocity_=velocity;
+	yawrate_=yawrate;
+}
+
+bool Geofence::update(double x, double y, double theta, float& velocity, float& yawrate)
+{
+	if(zones_.empty()){
+		return false;
+	}
+	boost::mutex::scoped_lock lock(mutex_);
+	x_=x;
+	y_=y;
+	theta_=theta;
+	if(velocity_==0 && yawrate_==0){
+		return false;
+	}
+
+	velocity=velocity_;
+	yawrate=yawrate_;
+	limit(velocity, yawrate);
+	if(velocity==velocity_ && yawrate==yawrate_){
+		return false;
+	}
+	ROS_WARN_THROTTLE(1.0, "geofence: running command limited to %.2f m/s %.2f rad/s", velocity, yawrate);
+	return true;
+}
+
+double Geofence::meanCheckTime() const
+{
+	return checks_>0 ? total_check_/checks_ : 0;
+}
@@ -0,0 +1,131 @@
+//---------------------------< /-/ AMSL /-/ >------------------------------
+/**
+ * file         :       light_bumper_scan.cpp
+ *
+ *
+ * Environment  :       g++
+ *
+ */
+//-----------------------------------------------------------------------------
+
+#include "roomba_500driver_meiji/light_bumper_scan.h"
+
+#include <cmath>
+#include <limits>
+
+using namespace roomba_500driver_meiji;
+
+static const char* SENSOR_NAMES[LightBumperScan::LB_NUM]={
+	"right", "front_right", "center_right", "center_left", "front_left", "left"
+};
+
+static const float ROBOT_RADIUS=0.17;	// m, bumper distance from the center
+static const float SENSOR_SPACING=26.0*M_PI/180.0;	// rad, sensors are +-13, 39, 65 deg
+
+// rough default calibration, distance from the bumper [m] for a reflective
+// wall. measure your own for each robot.
+static const double DEFAULT_INTENSITY[]={ 10,   30,   100,  300,  1000, 3000 };
+static const double DEFAULT_RANGE[]=    { 0.15, 0.10, 0.06, 0.03, 0.01, 0.0  };
+
+LightBumperScan::LightBumperScan(ros::NodeHandle& n, ros::NodeHandle& pn)
+{
+	std::string frame;
+	pn.param("light_bumper_frame", frame, std::string("base_link"));
+
+	std::vector<double> def_i(DEFAULT_INTENSITY, DEFAULT_INTENSITY+sizeof(DEFAULT_INTENSITY)/sizeof(double));
+	std::vector<double> def_r(DEFAULT_RANGE, DEFAULT_RANGE+sizeof(DEFAULT_RANGE)/sizeof(double));
+
+	float max_range=0;
+	for(int s=0; s<LB_NUM; s++){
+		std::string base=std::string("light_bumper/")+SENSOR_NAMES[s];
+		std::vector<double> cal_i, cal_r;
+		if(!pn.getParam(base+"/intensity", cal_i) || !pn.getParam(base+"/range", cal_r)
+			|| cal_i.size()!=cal_r.size() || cal_i.size()<2){
+			cal_i=def_i;
+			cal_r=def_r;
+		}
+		buildLut((SENSOR)s, cal_i, cal_r);
+
+		for(size_t k=0; k<cal_r.size(); k++){
+			max_range=std::max(max_range, (float)cal_r[k]);
+		}
+	}
+
+	scan_.header.frame_id=frame;
+	scan_.angle_min=-2.5*SENSOR_SPACING;
+	scan_.angle_max=2.5*SENSOR_SPACING;
+	scan_.angle_increment=SENSOR_SPACING;
+	scan_.time_increment=0;
+	scan_.scan_time=0;
+	scan_.range_min=ROBOT_RADIUS;
+	scan_.range_max=ROBOT_RADIUS+max_range;
+	scan_.ranges.resize(LB_NUM);
+	scan_.intensities.resize(LB_NUM);
+
+	pub_=n.advertise<sensor_msgs::LaserScan>("/roomba/light_bumper_scan", 10);
+}
+
+// calibration points are (intensity, range) pairs sorted by intensity.
+// between points the range is interpolated linearly, below the weakest
+// point nothing is seen.
+void LightBumperScan::buildLut(SENSOR s, const std::vector<double>& intensity, const std::vector<double>& range)
+{
+	std::vector<float>& lut=lut_[s];
+	lut.resize(LUT_SIZE);
+
+	size_t k=0;
+	for(int i=0; i<LUT_SIZE; i++){
+		if(i<intensity.front()){
+			lut[i]=std::numeric_limits<float>::infinity();
+			continue;
+		}
+		while(k+1<intensity.size() && i>intensity[k+1]){
+			k++;
+		}
+
+		double r;
+		if(k+1>=intensity.size()){
+			r=range.back();
+		}else{
+			double span=intensity[k+1]-intensity[k];
+			double t= span>0 ? (i-intensity[k])/span : 0;
+			if(t>1) t=1;
+			r=range[k]+t*(range[k+1]-range[k]);
+		}
+		lut[i]=ROBOT_RADIUS+r;
+	}
+}
+
+float LightBumperScan::range(SENSOR s, int intensity) const
+{
+	if(intensity<0){
+		intensity=0;
+	}
+	if(intensity>=LUT_SIZE){
+		intensity=LUT_SIZE-1;
+	}
+	return lut_[s][intensity];
+}
+
+void LightBumperScan::publish(const Roomba500State& sens)
+{
+	if(pub_.getNumSubscribers()==0){
+		return;
+	}
+
+	int intensity[LB_NUM];
+	intensity[LB_RIGHT]=sens.light_bumper.right;
+	intensity[LB_FRONT_RIGHT]=sens.light_bumper.front_right;
+	intensity[LB_CENTER_RIGHT]=sens.light_bumper.center_right;
+	intensity[LB_CENTER_LEFT]=sens.light_bumper.center_left;
+	intensity[LB_FRONT_LEFT]=sens.light_bumper.front_left;
+	intensity[LB_LEFT]=sens.light_bumper.left;
+
+	scan_.header.stamp=sens.header.stamp;
+	for(int s=0; s<LB_NUM; s++){
+		scan_.ranges[s]=range((SENSOR)s, intensity[s]);
+		scan_.intensities[s]=intensity[s];
+	}
+
+	pub_.publish(scan_);
+}
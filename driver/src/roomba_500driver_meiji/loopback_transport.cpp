@@ -0,0 +1,78 @@
+//---------------------------< /-/ AMSL /-/ >------------------------------
+/**
+ * file         :       loopback_transport.cpp
+ *
+ *
+ * Environment  :       g++
+ *
+ */
+//-----------------------------------------------------------------------------
+
+#include <fcntl.h>
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "roomba_500driver_meiji/loopback_transport.h"
+
+// the pipe only carries the bytes and makes fd() readable
+LoopbackTransport::LoopbackTransport(Responder* responder)
+:responder_(responder),recording_(false)
+{
+	pipe_[0]=pipe_[1]=-1;
+	// a failure shows in isOpen(), open() may be retried
+	open();
+}
+
+LoopbackTransport::~LoopbackTransport()
+{
+	if(pipe_[0]>=0){
+		::close(pipe_[0]);
+		::close(pipe_[1]);
+	}
+}
+
+bool LoopbackTransport::open()
+{
+	if(pipe_[0]>=0){
+		return true;
+	}
+	if(pipe(pipe_)<0){
+		perror("loopback transport: Unable to create pipe ");
+		pipe_[0]=pipe_[1]=-1;
+		return false;
+	}
+	fcntl(pipe_[0], F_SETFL, fcntl(pipe_[0], F_GETFL)|O_NONBLOCK);
+	fcntl(pipe_[1], F_SETFL, fcntl(pipe_[1], F_GETFL)|O_NONBLOCK);
+	return true;
+}
+
+int LoopbackTransport::read(unsigned char* p, int len)
+{
+	return readFd(pipe_[0], p, len);
+}
+
+int LoopbackTransport::write(const unsigned char* p, int len)
+{
+	if(recording_){
+		written_.insert(written_.end(), p, p+len);
+	}
+	if(responder_){
+		responder_->received(*this, p, len);
+	}
+	return len;
+}
+
+int LoopbackTransport::inject(const unsigned char* p, int len)
+{
+	if(pipe_[1]<0){
+		return 0;
+	}
+	// never block here, a full pipe would dead-lock a single thread
+	int n;
+	do{
+		n=::write(pipe_[1], p, len);
+	}while(n<0 && errno==EINTR);
+
+	return n<0 ? 0 : n;
+}
@@ -0,0 +1,137 @@
+//---------------------------< /-/ AMSL /-/ >------------------------------
+/**
+ * file         :       odometry_checkpoint.cpp
+ *
+ *
+ * Environment  :       g++
+ *
+ */
+//-----------------------------------------------------------------------------
+
+#include "roomba_500driver_meiji/odometry_checkpoint.h"
+#include "roomba_500driver_meiji/roomba500sci.h"
+#include "ros/ros.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <cstdlib>
+
+OdometryCheckpoint::OdometryCheckpoint(const std::string& path)
+:file_(NULL),sequence_(0),ticks_left_(0),ticks_right_(0){
+	int fd=open(path.c_str(), O_CREAT|O_RDWR, 0644);
+	if(fd<0){
+		ROS_ERROR("open %s: %s", path.c_str(), strerror(errno));
+		return;
+	}
+	if(ftruncate(fd, sizeof(File))<0){
+		ROS_ERROR("ftruncate %s: %s", path.c_str(), strerror(errno));
+		::close(fd);
+		return;
+	}
+	void* p=mmap(NULL, sizeof(File), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);
+	if(p==MAP_FAILED){
+		ROS_ERROR("mmap %s: %s", path.c_str(), strerror(errno));
+		return;
+	}
+
+	file_=(File*)p;
+	if(file_->magic!=CHECKPOINT_MAGIC || file_->version!=CHECKPOINT_VERSION){
+		memset(p, 0, sizeof(File));
+		file_->magic=CHECKPOINT_MAGIC;
+		file_->version=CHECKPOINT_VERSION;
+	}
+}
+
+OdometryCheckpoint::~OdometryCheckpoint()
+{
+	if(file_){
+		msync(file_, sizeof(File), MS_SYNC);
+		munmap(file_, sizeof(File));
+	}
+}
+
+uint32_t OdometryCheckpoint::checksum(const Record& rec)
+{
+	// FNV-1a over everything after the check field
+	const unsigned char* p=(const unsigned char*)&rec.stamp;
+	const unsigned char* end=(const unsigned char*)(&rec+1);
+	uint32_t h=2166136261u;
+	for(; p<end; p++){
+		h=(h^*p)*16777619u;
+	}
+	return h^rec.sequence;
+}
+
+bool OdometryCheckpoint::load(Record& rec) const
+{
+	if(!file_){
+		return false;
+	}
+	const Record* best=NULL;
+	for(int i=0; i<2; i++){
+		const Record& r=file_->slot[i];
+		if(r.sequence==0 || r.check!=checksum(r)){
+			continue;
+		}
+		if(!best || r.sequence>best->sequence){
+			best=&r;
+		}
+	}
+	if(!best){
+		return false;
+	}
+	rec=*best;
+	return true;
+}
+
+bool OdometryCheckpoint::matches(const Record& rec, unsigned short encoder_left, unsigned short encoder_right,
+	int tolerance, double max_age, double now)
+{
+	if(max_age>0 && (now-rec.stamp>max_age || now<rec.stamp)){
+		return false;
+	}
+	return roombaSci::encoderNear(encoder_left, rec.encoder_left, tolerance)
+		&& roombaSci::encoderNear(encoder_right, rec.encoder_right, tolerance);
+}
+
+void OdometryCheckpoint::restore(const Record& rec)
+{
+	ticks_left_=rec.ticks_left;
+	ticks_right_=rec.ticks_right;
+	sequence_=rec.sequence;
+}
+
+void OdometryCheckpoint::save(const geometry_msgs::Pose2D& pose, int d_ticks_left, int d_ticks_right,
+	unsigned short encoder_left, unsigned short encoder_right, double now)
+{
+	ticks_left_+=d_ticks_left;
+	ticks_right_+=d_ticks_right;
+	if(!file_){
+		return;
+	}
+
+	// the slot not holding the newest record
+	sequence_++;
+	if(sequence_==0){
+		sequence_=1;
+	}
+	Record& r=file_->slot[sequence_&1];
+	r.check=0;
+	__sync_synchronize();
+	r.stamp=now;
+	r.x=pose.x;
+	r.y=pose.y;
+	r.theta=pose.theta;
+	r.ticks_left=ticks_left_;
+	r.ticks_right=ticks_right_;
+	r.encoder_left=encoder_left;
+	r.encoder_right=encoder_right;
+	r.reserved=0;
+	r.sequence=sequence_;
+	__sync_synchronize();
+	r.check=checksum(r);
+}
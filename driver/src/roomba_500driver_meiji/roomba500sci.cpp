@@ -17,8 +17,11 @@
 //-----------------------------------------------------------------------------
 
 #include "roomba_500driver_meiji/roomba500sci.h"
+#include "roomba_500driver_meiji/oi_packet.h"
+#include "roomba_500driver_meiji/trace.h"
 #include "ros/ros.h"
 
+#include <boost/bind.hpp>
 #include <iostream>
 #include <cmath>
 using namespace std;
@@ -26,115 +29,282 @@ using namespace std;
 roombaSci::roombaSci(int baud, const char* dev)
 :enc_count_l_(0),enc_count_r_(0),
 d_enc_count_l_(0),d_enc_count_r_(0),
-d_pre_enc_l_(0), d_pre_enc_r_(0){
-	ser_ = new Serial(baud,dev,80,0);
+d_pre_enc_l_(0), d_pre_enc_r_(0),
+valid_frame_(false),enc_initialized_(false),enc_resync_(false),enc_resynced_(false),last_frame_time_(0),
+oi_mode_(OI_UNKNOWN),confirmed_mode_(OI_UNKNOWN),
+connected_(false),missed_frames_(0),lost_time_(0),next_attempt_(0),
+backoff_(RECONNECT_MIN_WAIT),reconnects_(0),recovery_time_(0){
+	transport_ = Transport::create(dev,baud);
+	init();
+}
+
+roombaSci::roombaSci(Transport* transport)
+:enc_count_l_(0),enc_count_r_(0),
+d_enc_count_l_(0),d_enc_count_r_(0),
+d_pre_enc_l_(0), d_pre_enc_r_(0),
+valid_frame_(false),enc_initialized_(false),enc_resync_(false),enc_resynced_(false),last_frame_time_(0),
+oi_mode_(OI_UNKNOWN),confirmed_mode_(OI_UNKNOWN),
+connected_(false),missed_frames_(0),lost_time_(0),next_attempt_(0),
+backoff_(RECONNECT_MIN_WAIT),reconnects_(0),recovery_time_(0){
+	transport_ = transport;
+	init();
+}
+
+// the encoder baseline is taken from the first packet, so no packet has
+// to be read here
+void roombaSci::init()
+{
 	time_= new Timer();
 
-	time_->sleep(1);
-	roomba_500driver_meiji::Roomba500State sensor;
-	getSensors(sensor);
+	connected_=transport_->isOpen();
+	lost_time_=Timer::now();
+}
 
+void roombaSci::linkLost(const char* reason)
+{
+	ROS_WARN("roomba link lost: %s", reason);
+
+	transport_->close();
+	connected_=false;
+	lost_time_=Timer::now();
+	next_attempt_=lost_time_;
+	backoff_=RECONNECT_MIN_WAIT;
+	assumeMode(OI_UNKNOWN);
+}
+
+bool roombaSci::reconnect()
+{
+	if(connected_){
+		return true;
+	}
+	if(Timer::now()<next_attempt_){
+		return false;
+	}
+
+	if(transport_->open()){
+		wakeup();
+		if(startup(RECONNECT_STARTUP_TIMEOUT)){
+			connected_=true;
+			missed_frames_=0;
+			// the robot went on driving, the baseline is kept so that
+			// the motion shows up in the first frame
+			enc_resync_=enc_initialized_;
+			backoff_=RECONNECT_MIN_WAIT;
+			reconnects_++;
+			recovery_time_=Timer::now()-lost_time_;
+			ROS_WARN("roomba link recovered after %.2f sec", recovery_time_);
+			return true;
+		}
+		transport_->close();
+	}
+
+	next_attempt_=Timer::now()+backoff_;
+	backoff_=std::min(2*backoff_, RECONNECT_MAX_WAIT);
+	return false;
 }
 
 roombaSci::~roombaSci()
 {
-	delete ser_;
+	delete transport_;
 	delete time_;
 
 }
 
 
+// the BRC pulse itself has to be long enough to be seen by the robot.
+// startup() probes for the reply, so no wait is needed afterwards
 void roombaSci::wakeup(void)
 {
-	ser_->setRts(0);
+	transport_->setRts(0);
 	time_->sleep(0.1);
-	ser_->setRts(1);
-	time_->sleep(COMMAND_WAIT);
+	transport_->setRts(1);
 }
 
-void roombaSci::startup(void)
+bool roombaSci::startup(float timeout)
 {
-	sendOPCODE(roombaSci::OC_START);
-	sendOPCODE(roombaSci::OC_CONTROL);
+	double deadline=Timer::now()+timeout;
+	cancelPending(CONFIRM_MODE);
+
+	const unsigned char start[]={OC_START};
+	transport_->write(start,1);
+	if(!waitReady(deadline-Timer::now())){
+		assumeMode(OI_UNKNOWN);
+		return false;
+	}
+
+	const unsigned char control[]={OC_CONTROL};
+	transport_->write(control,1);
+	assumeMode(OI_SAFE);
+	return waitReady(deadline-Timer::now(), OI_SAFE);
+}
+
+int roombaSci::queryMode(float timeout)
+{
+	transport_->flushInput();
+
+	const unsigned char seq[]={OC_SENSORS, OI_MODE_PACKET};
+	if(transport_->write(seq,2)<0){
+		time_->sleep(timeout);
+		return -1;
+	}
+
+	unsigned char mode;
+	if(transport_->readFull(&mode,1,timeout)!=1 || mode>OI_FULL){
+		return -1;
+	}
+	return mode;
+}
+
+bool roombaSci::waitReady(float timeout, int mode)
+{
+	double deadline=Timer::now()+timeout;
+
+	do{
+		int m=queryMode();
+		if(m>=0 && (mode<0 || m==mode)){
+			oi_mode_=confirmed_mode_=m;
+			return true;
+		}
+	}while(Timer::now()<deadline);
+
+	return false;
 }
 
 void roombaSci::powerOff(){
-	sendOPCODE(roombaSci::OC_POWER);
-	time_->sleep(COMMAND_WAIT);
+	const unsigned char seq[]={OC_POWER};
+	transport_->write(seq,1);
+	transport_->drain();
+	assumeMode(OI_UNKNOWN);
 }
 
+// cleaning and docking hand the robot to passive mode
 void roombaSci::clean(){
 	sendOPCODE(roombaSci::OC_CLEAN);
 	time_->sleep(COMMAND_WAIT);
+	assumeMode(OI_PASSIVE);
 }
 
-void roombaSci::safe(){
+void roombaSci::safe(bool force){
+	cancelPending(CONFIRM_MODE);
+	if(!force && confirmed_mode_==OI_SAFE){
+		return;
+	}
 	sendOPCODE(roombaSci::OC_SAFE);
 	time_->sleep(COMMAND_WAIT);
+	assumeMode(OI_SAFE);
 }
-void roombaSci::full(){
+void roombaSci::full(bool force){
+	cancelPending(CONFIRM_MODE);
+	if(!force && confirmed_mode_==OI_FULL){
+		return;
+	}
 	sendOPCODE(roombaSci::OC_FULL);
 	time_->sleep(COMMAND_WAIT);
+	assumeMode(OI_FULL);
 }
 void roombaSci::spot(){
 	sendOPCODE(roombaSci::OC_SPOT);
 	time_->sleep(COMMAND_WAIT);
+	assumeMode(OI_PASSIVE);
 }
 void roombaSci::max(){
 	sendOPCODE(roombaSci::OC_MAX);
 	time_->sleep(COMMAND_WAIT);
+	assumeMode(OI_PASSIVE);
 }
 
 void roombaSci::dock(){
+	ROOMBA_TRACE_SCOPE("command_write");
 	const unsigned char seq[]={OC_BUTTONS, roombaSci::BUTTON_DOCK};
-	ser_->write(seq,2);
+	transport_->write(seq,2);
 	time_->sleep(COMMAND_WAIT);
+	assumeMode(OI_PASSIVE);
 }
 
 // example
 // MB_MAIN_BRUSH | MB_VACUUM | MB_SIDE_BRUSH
 // puts all motors driving.
 void roombaSci::driveMotors(roombaSci::MOTOR_BITS state){
+	ROOMBA_TRACE_SCOPE("command_write");
 	const unsigned char seq[]={OC_MOTORS, state};
-	ser_->write(seq,2);
+	transport_->write(seq,2);
 	time_->sleep(COMMAND_WAIT);
 }
 
 void roombaSci::forceSeekingDock(){
 	const unsigned char seq[]={OC_FORCE_SEEKING_DOCK};
-	ser_->write(seq,1);
+	transport_->write(seq,1);
 	time_->sleep(COMMAND_WAIT);
+	assumeMode(OI_PASSIVE);
 }
 
 
 
-void roombaSci::drive(short velocity, short radius){
+void roombaSci::driveSequence(unsigned char* seq, short velocity, short radius){
 
 	unsigned char vhi = (unsigned char)(velocity >> 8);
 	unsigned char vlo = (unsigned char)(velocity & 0xff);
 	unsigned char rhi = (unsigned char)(radius   >> 8);
 	unsigned char rlo = (unsigned char)(radius   & 0xff);
 
-	const unsigned char seq[]={OC_DRIVE, vhi, vlo, rhi, rlo};
-	ser_->write(seq,5);
+	seq[0]=OC_DRIVE;
+	seq[1]=vhi;	seq[2]=vlo;
+	seq[3]=rhi;	seq[4]=rlo;
+}
+
+void roombaSci::drive(short velocity, short radius){
+	ROOMBA_TRACE_SCOPE("command_write");
+	filterDrive(velocity, radius);
+	cancelPending(CONFIRM_DRIVE);
+	cancelPending(CONFIRM_DRIVE_DIRECT);
+
+	unsigned char seq[5];
+	driveSequence(seq, velocity, radius);
+	transport_->write(seq,5);
 	time_->sleep(COMMAND_WAIT);
 }
 
-void roombaSci::driveDirect(float velocity, float yawrate){
-	short right=1000*(velocity+0.5*0.235*yawrate);
-	short left=1000*(velocity-0.5*0.235*yawrate);
+void roombaSci::driveDirectSequence(unsigned char* seq, float velocity, float yawrate){
+	float right_mm=1000*(velocity+0.5*0.235*yawrate);
+	float left_mm=1000*(velocity-0.5*0.235*yawrate);
+
+	// scale both wheels down together so that the turning radius is kept
+	float peak=std::max(std::fabs(right_mm),std::fabs(left_mm));
+	if(peak>MAX_WHEEL_VELOCITY){
+		right_mm*=MAX_WHEEL_VELOCITY/peak;
+		left_mm*=MAX_WHEEL_VELOCITY/peak;
+	}
+	short right=(short)right_mm;
+	short left=(short)left_mm;
 
 	unsigned char rhi =  (unsigned char)(right >> 8);
 	unsigned char  rlo = (unsigned char)(right & 0xff);
 	unsigned char  lhi = (unsigned char)(left  >> 8);
 	unsigned char  llo = (unsigned char)(left  & 0xff);
 
-	const unsigned char seq[]={OC_DRIVE_DIRECT, rhi, rlo, lhi, llo};
-	ser_->write(seq,5);
+	seq[0]=OC_DRIVE_DIRECT;
+	seq[1]=rhi;	seq[2]=rlo;
+	seq[3]=lhi;	seq[4]=llo;
+}
+
+void roombaSci::driveDirect(float velocity, float yawrate){
+	ROOMBA_TRACE_SCOPE("command_write");
+	filterDriveDirect(velocity, yawrate);
+	cancelPending(CONFIRM_DRIVE);
+	cancelPending(CONFIRM_DRIVE_DIRECT);
+
+	unsigned char seq[5];
+	driveDirectSequence(seq, velocity, yawrate);
+	transport_->write(seq,5);
 	time_->sleep(COMMAND_WAIT);
 }
 
 void roombaSci::drivePWM(int right_pwm, int left_pwm){
+	ROOMBA_TRACE_SCOPE("command_write");
+	filterPWM(right_pwm, left_pwm);
+	cancelPending(CONFIRM_DRIVE);
+	cancelPending(CONFIRM_DRIVE_DIRECT);
+
 	short right=255.0/100.0*right_pwm;
 	short left=255.0/100.0*left_pwm;
 
@@ -145,10 +315,77 @@ void roombaSci::drivePWM(int right_pwm, int left_pwm){
 	unsigned char llo = (unsigned char)(left & 0xff);
 
 	const unsigned char seq[]={OC_DRIVE_PWM, rhi, rlo, lhi, llo};
-	ser_->write(seq,5);
+	transport_->write(seq,5);
 	time_->sleep(COMMAND_WAIT);
 }
 
+void roombaSci::filterDriveDirect(float& velocity, float& yawrate)
+{
+	if(drive_filter_){
+		drive_filter_(velocity, yawrate);
+	}
+}
+
+// DRIVE is converted to velocity and yawrate for the filter and back
+void roombaSci::filterDrive(short& velocity, short& radius)
+{
+	if(!drive_filter_){
+		return;
+	}
+	const float half_base=0.5*0.235;
+	// 0 is not a radius, the all zero DRIVE stops
+	bool straight=(radius==(short)0x8000 || radius==0x7fff || radius==0);
+	float v, w;
+	if(straight){
+		v=velocity/1000.0;
+		w=0;
+	}else if(radius==1 || radius==-1){
+		// turn in place, velocity is the wheel speed
+		v=0;
+		w=radius*velocity/1000.0/half_base;
+	}else{
+		v=velocity/1000.0;
+		w=(float)velocity/radius;
+	}
+
+	float fv=v, fw=w;
+	drive_filter_(fv, fw);
+	if(fv==v && fw==w){
+		return;
+	}
+	if(fv==0 && fw==0){
+		velocity=0;
+	}else if(fv==0){
+		radius=(fw>0) ? 1 : -1;
+		velocity=(short)(std::fabs(fw)*half_base*1000);
+	}else{
+		// the filter scales both together, so the radius is kept
+		velocity=(short)(fv*1000);
+	}
+}
+
+void roombaSci::filterPWM(int& right_pwm, int& left_pwm)
+{
+	if(!drive_filter_){
+		return;
+	}
+	// rough wheel speeds, full PWM taken as the top speed
+	const float half_base=0.5*0.235;
+	float right=right_pwm/100.0*MAX_WHEEL_VELOCITY/1000.0;
+	float left=left_pwm/100.0*MAX_WHEEL_VELOCITY/1000.0;
+	float v=(right+left)/2, w=(right-left)/(2*half_base);
+
+	float fv=v, fw=w;
+	drive_filter_(fv, fw);
+	if(fv==v && fw==w){
+		return;
+	}
+	right=fv+fw*half_base;
+	left=fv-fw*half_base;
+	right_pwm=(int)(right*1000.0/MAX_WHEEL_VELOCITY*100);
+	left_pwm=(int)(left*1000.0/MAX_WHEEL_VELOCITY*100);
+}
+
 float roombaSci::velToPWM(float velocity){
 	float pwm;
 	if(velocity>0){
@@ -162,169 +399,436 @@ float roombaSci::velToPWM(float velocity){
 }
 
 void roombaSci::song(int song_number, int song_length){
-	const unsigned char mode_seq[]={OC_SAFE};
-
-	ser_->write(mode_seq,1);
-	time_->sleep(COMMAND_WAIT);
+	// playing needs safe or full. do not drop full mode to safe
+	if(oi_mode_!=OI_FULL){
+		safe();
+	}
 
 	const unsigned char command_seq[]={OC_SONG, song_number, song_length, 60, 126};
 
-	ser_->write(command_seq,2*song_length+3);
+	transport_->write(command_seq,2*song_length+3);
 	time_->sleep(COMMAND_WAIT);
 }
 
 void roombaSci::playing(int song_number){
 	const unsigned char command_seq[]={OC_PLAY, song_number};
 
-	ser_->write(command_seq,2);
+	transport_->write(command_seq,2);
 	time_->sleep(COMMAND_WAIT);
 }
 
 
+// sent or expected, not seen in a packet yet
+void roombaSci::assumeMode(int mode)
+{
+	oi_mode_=mode;
+	confirmed_mode_=OI_UNKNOWN;
+}
+
+void roombaSci::passiveAsync(CommandCallback done, float timeout, int retries, bool force){
+	modeAsync(OC_START, OI_PASSIVE, done, timeout, retries, force);
+}
+
+void roombaSci::safeAsync(CommandCallback done, float timeout, int retries, bool force){
+	modeAsync(OC_SAFE, OI_SAFE, done, timeout, retries, force);
+}
+
+void roombaSci::fullAsync(CommandCallback done, float timeout, int retries, bool force){
+	modeAsync(OC_FULL, OI_FULL, done, timeout, retries, force);
+}
+
+static void callBoth(roombaSci::CommandCallback first, roombaSci::CommandCallback second, bool ok)
+{
+	if(first){
+		first(ok);
+	}
+	if(second){
+		second(ok);
+	}
+}
+
+void roombaSci::modeAsync(OPCODE oc, OI_MODE mode,
+	CommandCallback done, float timeout, int retries, bool force)
+{
+	if(!force){
+		boost::mutex::scoped_lock lock(pending_mutex_);
+		PendingCommand* pending=NULL;
+		for(std::deque<PendingCommand>::iterator it=pending_.begin(); it!=pending_.end(); ++it){
+			if(it->kind==CONFIRM_MODE){
+				pending=&*it;
+			}
+		}
+		// the same request is on its way, wait for its confirmation too
+		if(pending && pending->expect_a==mode){
+			pending->done=boost::bind(callBoth, pending->done, done, _1);
+			return;
+		}
+		// only a mode the robot reported is skipped
+		if(!pending && confirmed_mode_==mode){
+			lock.unlock();
+			if(done){
+				done(true);
+			}
+			return;
+		}
+	}
+
+	const unsigned char seq[]={(unsigned char)oc};
+	sendAsync(CONFIRM_MODE, seq, 1, mode, 0, done, timeout, retries);
+	assumeMode(mode);
+}
+
+void roombaSci::driveAsync(short velocity, short radius,
+	CommandCallback done, float timeout, int retries)
+{
+	filterDrive(velocity, radius);
+	cancelPending(CONFIRM_DRIVE_DIRECT);
+
+	unsigned char seq[5];
+	driveSequence(seq, velocity, radius);
+	sendAsync(CONFIRM_DRIVE, seq, 5, velocity, radius, done, timeout, retries);
+}
+
+void roombaSci::driveDirectAsync(float velocity, float yawrate,
+	CommandCallback done, float timeout, int retries)
+{
+	filterDriveDirect(velocity, yawrate);
+	cancelPending(CONFIRM_DRIVE);
+
+	unsigned char seq[5];
+	driveDirectSequence(seq, velocity, yawrate);
+	short right=(short)((seq[1]<<8)|seq[2]);
+	short left=(short)((seq[3]<<8)|seq[4]);
+	sendAsync(CONFIRM_DRIVE_DIRECT, seq, 5, right, left, done, timeout, retries);
+}
+
+void roombaSci::sendAsync(CONFIRM_KIND kind, const unsigned char* seq, int len,
+	short expect_a, short expect_b, CommandCallback done, float timeout, int retries)
+{
+	cancelPending(kind);
+
+	PendingCommand cmd;
+	cmd.kind=kind;
+	cmd.seq.assign(seq, seq+len);
+	cmd.expect_a=expect_a;
+	cmd.expect_b=expect_b;
+	cmd.deadline=Timer::now()+timeout;
+	cmd.timeout=timeout;
+	cmd.retries=retries;
+	cmd.done=done;
+
+	if(transport_->write(seq,len)<0){
+		// the link is down, count it as a failed try
+		cmd.deadline=Timer::now();
+	}
+	boost::mutex::scoped_lock lock(pending_mutex_);
+	pending_.push_back(cmd);
+}
+
+void roombaSci::cancelPending(CONFIRM_KIND kind)
+{
+	std::vector<CommandCallback> failed;
+	boost::mutex::scoped_lock lock(pending_mutex_);
+	for(std::deque<PendingCommand>::iterator it=pending_.begin(); it!=pending_.end();){
+		if(it->kind==kind){
+			failed.push_back(it->done);
+			it=pending_.erase(it);
+		}else{
+			++it;
+		}
+	}
+	lock.unlock();
+
+	for(size_t i=0; i<failed.size(); i++){
+		if(failed[i]){
+			failed[i](false);
+		}
+	}
+}
+
+// sensor is NULL when no packet was received this cycle
+void roombaSci::checkPending(const roomba_500driver_meiji::Roomba500State* sensor)
+{
+	ROOMBA_TRACE_SCOPE("check_pending");
+	boost::mutex::scoped_lock lock(pending_mutex_);
+	if(pending_.empty()){
+		return;
+	}
+
+	// callbacks may send new commands, so call them after the loop
+	std::vector<std::pair<CommandCallback, bool> > finished;
+	double now=Timer::now();
+
+	for(std::deque<PendingCommand>::iterator it=pending_.begin(); it!=pending_.end();){
+		bool confirmed=false;
+		if(sensor){
+			switch(it->kind){
+				case CONFIRM_MODE:
+					confirmed=(sensor->open_interface_mode==it->expect_a);
+					break;
+				case CONFIRM_DRIVE:
+					confirmed=(sensor->requested_velocity==it->expect_a &&
+						sensor->requested_radius==it->expect_b);
+					break;
+				case CONFIRM_DRIVE_DIRECT:
+					confirmed=(sensor->requested_wheel_velocity.right==it->expect_a &&
+						sensor->requested_wheel_velocity.left==it->expect_b);
+					break;
+			}
+		}
+
+		if(confirmed){
+			finished.push_back(std::make_pair(it->done, true));
+			it=pending_.erase(it);
+			continue;
+		}
+
+		if(now>=it->deadline){
+			if(it->retries>0){
+				it->retries--;
+				it->deadline=now+it->timeout;
+				transport_->write(&it->seq[0], it->seq.size());
+			}else{
+				finished.push_back(std::make_pair(it->done, false));
+				it=pending_.erase(it);
+				continue;
+			}
+		}
+		++it;
+	}
+	lock.unlock();
+
+	for(size_t i=0; i<finished.size(); i++){
+		if(finished[i].first){
+			finished[i].first(finished[i].second);
+		}
+	}
+}
+
 int roombaSci::sendOPCODE(roombaSci::OPCODE oc)
 {
+	ROOMBA_TRACE_SCOPE("command_write");
 	const unsigned char uc = (unsigned char)oc;
-	int ret = ser_->write(&uc,1);
+	int ret = transport_->write(&uc,1);
 	time_->sleep(COMMAND_WAIT);
 	return ret;
 }
 
 int roombaSci::receive(void)
 {
-	return ser_->read(packet_,80);
+	ROOMBA_TRACE_SCOPE("receive");
+	return transport_->readFull(packet_,80,RECEIVE_TIMEOUT);
 }
 
 int roombaSci::receive(unsigned char* pack, int byte)
 {
-	return ser_->read(pack,byte);
+	return transport_->readFull(pack,byte,RECEIVE_TIMEOUT);
 }
 
 int roombaSci::getSensors(roomba_500driver_meiji::Roomba500State& sensor){
-	const unsigned char seq[]={OC_SENSORS, ALL_PACKET};
-	int ret = ser_->write(seq,2);
+	ROOMBA_TRACE_SCOPE("get_sensors");
+	int ret=requestSensors();
+	if(ret<0){
+		return ret;
+	}
+
+	decodeSensors(sensor, receiveSensors());
+
 	time_->sleep(COMMAND_WAIT);
 
-	int nbyte;
-	nbyte=receive();
+	return ret;
+}
 
-	if(nbyte==80){
-		packetToStruct(sensor, packet_);
+int roombaSci::requestSensors()
+{
+	valid_frame_=false;
+	// no motion is known for a cycle without a packet
+	d_enc_count_l_=0;
+	d_enc_count_r_=0;
+
+	if(!connected_){
+		checkPending(NULL);
+		return -1;
 	}
 
-	time_->sleep(COMMAND_WAIT);
+	// left-over bytes of a short read would shift every following packet
+	transport_->flushInput();
 
+	const unsigned char seq[]={OC_SENSORS, ALL_PACKET};
+	int ret;
+	{
+		ROOMBA_TRACE_SCOPE("sensor_request");
+		ret = transport_->write(seq,2);
+	}
+	if(ret<0){
+		linkLost("write failed");
+		checkPending(NULL);
+	}
 	return ret;
 }
 
+void roombaSci::decodeSensors(roomba_500driver_meiji::Roomba500State& sensor, int nbyte)
+{
+	valid_frame_=(nbyte==80);
+	if(valid_frame_){
+		missed_frames_=0;
+		packetToStruct(sensor, packet_);
+	}else if(nbyte<0){
+		linkLost("read failed");
+	}else if(++missed_frames_>=MAX_MISSED_FRAMES){
+		linkLost("no packets");
+	}
+	checkPending(valid_frame_ ? &sensor : NULL);
+}
+
 
 void roombaSci::packetToStruct(
 	roomba_500driver_meiji::Roomba500State& ret,
 	const unsigned char* pack
 ){
+	ROOMBA_TRACE_SCOPE("packet_to_struct");
+
+	OIFrame frame(pack);
 
-	ret.bump.right=(bool)(0x01&pack[0]);
-	ret.bump.left=(bool)(0x01&(pack[0]>>1));
+	ret.bump.right=frame.bumpRight();
+	ret.bump.left=frame.bumpLeft();
 
-	ret.wheeldrop.right=(bool)(0x01&(pack[0]>>2));
-	ret.wheeldrop.left=(bool)(0x01&(pack[0]>>3));
-	ret.wheeldrop.caster=(bool)(0x01&(pack[0]>>4));
+	ret.wheeldrop.right=frame.wheeldropRight();
+	ret.wheeldrop.left=frame.wheeldropLeft();
+	ret.wheeldrop.caster=frame.wheeldropCaster();
 
 
-	ret.wall=(bool)(0x01&(pack[1]));
-	ret.wall_signal=(unsigned short)((pack[26]<<8)|pack[27]);
+	ret.wall=frame.wall();
+	ret.wall_signal=frame.wallSignal();
 
-	ret.cliff.left=(bool)(0x01&(pack[2]));
-	ret.cliff.front_left=(bool)(0x01&(pack[3]));
-	ret.cliff.right=(bool)(0x01&(pack[4]));
-	ret.cliff.front_right=(bool)(0x01&(pack[5]));
+	ret.cliff.left=frame.cliffLeft();
+	ret.cliff.front_left=frame.cliffFrontLeft();
+	ret.cliff.front_right=frame.cliffFrontRight();
+	ret.cliff.right=frame.cliffRight();
 
-	ret.dirt_detect=(unsigned short)(pack[8]);
+	ret.dirt_detect=frame.dirtDetect();
 
-	ret.cliff.left_signal=(unsigned short)((pack[28]<<8)|pack[29]);
-	ret.cliff.front_left_signal=(unsigned short)((pack[30]<<8)|pack[31]);
-	ret.cliff.front_right_signal=(unsigned short)((pack[32]<<8)|pack[33]);
-	ret.cliff.right_signal=(unsigned short)((pack[34]<<8)|pack[35]);
+	ret.cliff.left_signal=frame.cliffLeftSignal();
+	ret.cliff.front_left_signal=frame.cliffFrontLeftSignal();
+	ret.cliff.front_right_signal=frame.cliffFrontRightSignal();
+	ret.cliff.right_signal=frame.cliffRightSignal();
 
-	ret.virtual_wall=(bool)(0x01&(pack[6]));
+	ret.virtual_wall=frame.virtualWall();
 
-	ret.motor_overcurrents.side_brush=(bool)(0x01&(pack[7]));
-	ret.motor_overcurrents.vacuum=(bool)(0x01&(pack[7]>>1));
-	ret.motor_overcurrents.main_brush=(bool)(0x01&(pack[7]>>2));
-	ret.motor_overcurrents.drive_right=(bool)(0x01&(pack[7]>>3));
-	ret.motor_overcurrents.drive_left=(bool)(0x01&(pack[7]>>4));
+	ret.motor_overcurrents.side_brush=frame.bit(OFS_OVERCURRENTS, 0);
+	ret.motor_overcurrents.vacuum=frame.bit(OFS_OVERCURRENTS, 1);
+	ret.motor_overcurrents.main_brush=frame.bit(OFS_OVERCURRENTS, 2);
+	ret.motor_overcurrents.drive_right=frame.bit(OFS_OVERCURRENTS, 3);
+	ret.motor_overcurrents.drive_left=frame.bit(OFS_OVERCURRENTS, 4);
 
 
-	ret.dirt_detector.left=(pack[8]);
-	ret.dirt_detector.right=(pack[9]);
+	ret.dirt_detector.left=frame.u8(OFS_DIRT_DETECT);
+	ret.dirt_detector.right=frame.u8(OFS_UNUSED_1);
 
-	ret.remote_control_command=(pack[10]);
+	ret.remote_control_command=frame.irOmni();
 
-	ret.buttons.max=(bool)(0x01&(pack[11]));
-	ret.buttons.clean=(bool)(0x01&(pack[11]>>1));
-	ret.buttons.spot=(bool)(0x01&(pack[11]>>2));
-	ret.buttons.power=(bool)(0x01&(pack[11]>>3));
+	ret.buttons.max=frame.bit(OFS_BUTTONS, 0);
+	ret.buttons.clean=frame.bit(OFS_BUTTONS, 1);
+	ret.buttons.spot=frame.bit(OFS_BUTTONS, 2);
+	ret.buttons.power=frame.bit(OFS_BUTTONS, 3);
 
-	ret.distance=(short)((pack[12]<<8)|pack[13]);
-	ret.angle=(short)((pack[14]<<8)|pack[15]);
-	ret.requested_wheel_velocity.right=(short)((pack[48]<<8)|pack[49]);
-	ret.requested_wheel_velocity.left=(short)((pack[50]<<8)|pack[51]);
+	ret.distance=frame.distance();
+	ret.angle=frame.angle();
+	ret.requested_wheel_velocity.right=frame.requestedRightVelocity();
+	ret.requested_wheel_velocity.left=frame.requestedLeftVelocity();
 
-	ret.dirt_detect=(unsigned short)(pack[39]);
-	ret.open_interface_mode=(unsigned short)(pack[40]);
+	ret.charger_available=frame.chargerAvailable();
+	ret.open_interface_mode=frame.oiMode();
+	if(ret.open_interface_mode<=OI_FULL){
+		oi_mode_=confirmed_mode_=ret.open_interface_mode;
+	}
 
-	ret.song.number=(unsigned short)(pack[41]);
-	ret.song.playing=(unsigned short)(pack[42]);
+	ret.song.number=frame.songNumber();
+	ret.song.playing=frame.songPlaying();
+
+	ret.oi_stream_num_packets=frame.streamPackets();
+
+	ret.requested_velocity=frame.requestedVelocity();
+	ret.requested_radius=frame.requestedRadius();
+	ret.encoder_counts.left=frame.encoderLeft();
+	ret.encoder_counts.right=frame.encoderRight();
+
+	ret.light_bumper.bumper=frame.lightBumper();
+	ret.light_bumper.left=frame.lightBumpLeftSignal();
+	ret.light_bumper.front_left=frame.lightBumpFrontLeftSignal();
+	ret.light_bumper.center_left=frame.lightBumpCenterLeftSignal();
+	ret.light_bumper.center_right=frame.lightBumpCenterRightSignal();
+	ret.light_bumper.front_right=frame.lightBumpFrontRightSignal();
+	ret.light_bumper.right=frame.lightBumpRightSignal();
+
+	ret.opcode.left=frame.irLeft();
+	ret.opcode.right=frame.irRight();
+
+	ret.stasis=frame.stasis();
+
+	double now=Timer::now();
+	enc_resynced_=false;
+	if(!enc_initialized_){
+		enc_count_r_ = ret.encoder_counts.right;
+		enc_count_l_ = ret.encoder_counts.left;
+		enc_initialized_ = true;
+	}else if(enc_resync_){
+		// no wheel turns faster than MAX_WHEEL_VELOCITY, anything beyond
+		// that is a power cycle or a reset of the counts
+		enc_resync_=false;
+		double outage=now-last_frame_time_;
+		int bound=(int)std::min((double)ENCODER_RESYNC_MAX,
+			(outage+ENCODER_RESYNC_MARGIN)*MAX_WHEEL_VELOCITY*ENCODER_TICKS_PER_MM);
+		if(encoderNear(ret.encoder_counts.right, enc_count_r_, bound)
+			&& encoderNear(ret.encoder_counts.left, enc_count_l_, bound)){
+			enc_resynced_=true;
+		}else{
+			ROS_WARN("encoders moved more than %d ticks during the %.2f sec outage, odometry continues from here",
+				bound, outage);
+			enc_count_r_ = ret.encoder_counts.right;
+			enc_count_l_ = ret.encoder_counts.left;
+		}
+	}
+	last_frame_time_=now;
 
-	ret.oi_stream_num_packets=(unsigned short)(pack[43]);
+	d_enc_count_r_=encoderDelta(ret.encoder_counts.right, enc_count_r_);
+	d_enc_count_l_=encoderDelta(ret.encoder_counts.left, enc_count_l_);
 
-	ret.requested_velocity=(short)((pack[44]<<8)|pack[45]);
-	ret.requested_radius=(short)((pack[46]<<8)|pack[47]);
-	ret.encoder_counts.left=(unsigned short)((pack[52]<<8)|pack[53]);
-	ret.encoder_counts.right=(unsigned short)((pack[54]<<8)|pack[55]);
+	enc_count_r_ = ret.encoder_counts.right;
+	enc_count_l_ =  ret.encoder_counts.left;
 
-	ret.light_bumper.bumper=(unsigned short)(pack[56]);
-	ret.light_bumper.left=(unsigned short)((pack[57]<<8)|pack[58]);;
-	ret.light_bumper.front_left=(unsigned short)((pack[59]<<8)|pack[60]);
-	ret.light_bumper.center_left=(unsigned short)((pack[61]<<8)|pack[62]);
-	ret.light_bumper.center_right=(unsigned short)((pack[63]<<8)|pack[64]);
-	ret.light_bumper.front_right=(unsigned short)((pack[65]<<8)|pack[66]);
-	ret.light_bumper.right=(unsigned short)((pack[67]<<8)|pack[68]);
+	ret.charging_state=frame.chargingState();
+	ret.voltage=frame.voltage();
+	ret.current=frame.current();
+	ret.temperature=frame.u8(OFS_TEMPERATURE);
+	ret.charge=frame.charge();
+	ret.capacity=frame.capacity();
 
-	ret.opcode.left=(unsigned short)(pack[69]);
-	ret.opcode.right=(unsigned short)(pack[70]);
+}
 
-	ret.stasis=(bool)(0x01&(pack[79]));
 
-	if(std::abs((int)ret.encoder_counts.right-(int)enc_count_r_) >= 60000){
-		if(ret.encoder_counts.right > enc_count_r_){
-			d_enc_count_r_=-65535-enc_count_r_+ret.encoder_counts.right;
+int roombaSci::encoderDelta(unsigned int count, unsigned int pre)
+{
+	if(std::abs((int)count-(int)pre) >= 60000){
+		if(count > pre){
+			return -65535-pre+count;
 		}else{
-			d_enc_count_r_=65535-enc_count_r_+ret.encoder_counts.right;
+			return 65535-pre+count;
 		}
-	}else{
-		d_enc_count_r_=ret.encoder_counts.right - enc_count_r_;
 	}
+	return count - pre;
+}
 
-	if(std::abs((int)ret.encoder_counts.left-(int)enc_count_l_) >= 60000){
-		if(ret.encoder_counts.left > enc_count_l_){
-			d_enc_count_l_=-65535-enc_count_l_+ret.encoder_counts.left;
-		}else{
-			d_enc_count_l_=65535-enc_count_l_+ret.encoder_counts.left;
-		}
+void roombaSci::setEncoderBaseline(unsigned short left, unsigned short right)
+{
+	if(valid_frame_){
+		d_enc_count_l_=encoderDelta(enc_count_l_, left);
+		d_enc_count_r_=encoderDelta(enc_count_r_, right);
 	}else{
-		d_enc_count_l_=ret.encoder_counts.left - enc_count_l_;
+		enc_count_l_=left;
+		enc_count_r_=right;
+		enc_initialized_=true;
 	}
-
-	enc_count_r_ = ret.encoder_counts.right;
-	enc_count_l_ =  ret.encoder_counts.left;
-
-	ret.charging_state=pack[16];
-	ret.voltage=((pack[17]<<8)|pack[18]);
-	ret.current=((pack[19]<<8)|pack[20]);
-	ret.temperature=pack[21];
-	ret.charge=((pack[22]<<8)|pack[23]);
-	ret.capacity=((pack[24]<<8)|pack[25]);
-
 }
 
 
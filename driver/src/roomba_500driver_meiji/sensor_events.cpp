@@ -0,0 +1,100 @@
+//---------------------------< /-/ AMSL /-/ >------------------------------
+/**
+ * file         :       sensor_events.cpp
+ *
+ *
+ * Environment  :       g++
+ *
+ */
+//-----------------------------------------------------------------------------
+
+#include "roomba_500driver_meiji/sensor_events.h"
+
+using namespace roomba_500driver_meiji;
+
+SensorEvents::SensorEvents()
+:initialized_(false),bits_(0),
+opcode_left_(0),opcode_right_(0),remote_(0),charging_state_(0){
+}
+
+uint32_t SensorEvents::pack(const Roomba500State& s)
+{
+	uint32_t b=0;
+
+	if(s.bump.right)		b|=SensorEvent::BUMP_RIGHT;
+	if(s.bump.left)			b|=SensorEvent::BUMP_LEFT;
+	if(s.wheeldrop.right)	b|=SensorEvent::WHEELDROP_RIGHT;
+	if(s.wheeldrop.left)	b|=SensorEvent::WHEELDROP_LEFT;
+	if(s.wheeldrop.caster)	b|=SensorEvent::WHEELDROP_CASTER;
+	if(s.wall)				b|=SensorEvent::WALL;
+	if(s.cliff.left)		b|=SensorEvent::CLIFF_LEFT;
+	if(s.cliff.front_left)	b|=SensorEvent::CLIFF_FRONT_LEFT;
+	if(s.cliff.front_right)	b|=SensorEvent::CLIFF_FRONT_RIGHT;
+	if(s.cliff.right)		b|=SensorEvent::CLIFF_RIGHT;
+	if(s.virtual_wall)		b|=SensorEvent::VIRTUAL_WALL;
+
+	if(s.motor_overcurrents.side_brush)		b|=SensorEvent::OVERCURRENT_SIDE_BRUSH;
+	if(s.motor_overcurrents.vacuum)			b|=SensorEvent::OVERCURRENT_VACUUM;
+	if(s.motor_overcurrents.main_brush)		b|=SensorEvent::OVERCURRENT_MAIN_BRUSH;
+	if(s.motor_overcurrents.drive_right)	b|=SensorEvent::OVERCURRENT_DRIVE_RIGHT;
+	if(s.motor_overcurrents.drive_left)		b|=SensorEvent::OVERCURRENT_DRIVE_LEFT;
+
+	if(s.buttons.power)	b|=SensorEvent::BUTTON_POWER;
+	if(s.buttons.spot)	b|=SensorEvent::BUTTON_SPOT;
+	if(s.buttons.clean)	b|=SensorEvent::BUTTON_CLEAN;
+	if(s.buttons.max)	b|=SensorEvent::BUTTON_MAX;
+
+	if(s.stasis)	b|=SensorEvent::STASIS;
+
+	// light bumper bits (packet 45) are kept in their original order
+	b|=((uint32_t)(s.light_bumper.bumper&0x3f))*SensorEvent::LIGHT_BUMPER_LEFT;
+
+	return b;
+}
+
+bool SensorEvents::update(const Roomba500State& sens, SensorEvent& ev)
+{
+	uint32_t bits=pack(sens);
+	uint8_t opcode_left=(uint8_t)sens.opcode.left;
+	uint8_t opcode_right=(uint8_t)sens.opcode.right;
+	uint8_t remote=sens.remote_control_command;
+	uint8_t charging_state=sens.charging_state;
+
+	if(!initialized_){
+		initialized_=true;
+		bits_=bits;
+		opcode_left_=opcode_left;
+		opcode_right_=opcode_right;
+		remote_=remote;
+		charging_state_=charging_state;
+		return false;
+	}
+
+	uint32_t diff=bits^bits_;
+	uint8_t changed=0;
+	if(opcode_left!=opcode_left_)			changed|=SensorEvent::OPCODE_LEFT;
+	if(opcode_right!=opcode_right_)			changed|=SensorEvent::OPCODE_RIGHT;
+	if(remote!=remote_)						changed|=SensorEvent::REMOTE_CONTROL_COMMAND;
+	if(charging_state!=charging_state_)		changed|=SensorEvent::CHARGING_STATE;
+
+	bits_=bits;
+	opcode_left_=opcode_left;
+	opcode_right_=opcode_right;
+	remote_=remote;
+	charging_state_=charging_state;
+
+	if(diff==0 && changed==0){
+		return false;
+	}
+
+	ev.header=sens.header;
+	ev.state=bits;
+	ev.rising=diff&bits;
+	ev.falling=diff&~bits;
+	ev.changed=changed;
+	ev.opcode_left=opcode_left;
+	ev.opcode_right=opcode_right;
+	ev.remote_control_command=remote;
+	ev.charging_state=charging_state;
+	return true;
+}
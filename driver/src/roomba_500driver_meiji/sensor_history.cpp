@@ -0,0 +1,273 @@
+//---------------------------< /-/ AMSL /-/ >------------------------------
+/**
+ * file         :       sensor_history.cpp
+ *
+ *
+ * Environment  :       g++
+ *
+ */
+//-----------------------------------------------------------------------------
+
+#include "roomba_500driver_meiji/sensor_history.h"
+#include "roomba_500driver_meiji/shared_state_writer.h"
+#include "roomba_500driver_meiji/sensor_events.h"
+#include "roomba_500driver_meiji/slip_detector.h"
+#include "roomba_500driver_meiji/timer.h"
+
+#include <roomba_500driver_meiji/SensorEvent.h>
+
+#include <boost/bind.hpp>
+#include <stdio.h>
+
+using namespace roomba_500driver_meiji;
+
+static const double TRIGGER_COOLDOWN=10.0;	// sec between automatic dumps
+
+static const char* TRIGGER_NAMES[]={"bump", "wheeldrop", "cliff", "virtual_wall", "overcurrent"};
+static const int NUM_TRIGGERS=sizeof(TRIGGER_NAMES)/sizeof(TRIGGER_NAMES[0]);
+
+SensorHistory::SensorHistory(ros::NodeHandle& n, ros::NodeHandle& pn)
+:count_(0),trigger_mask_(0),stuck_trigger_(false),last_bits_(0),has_last_(false),
+dump_at_(0),cooldown_until_(0),snapshot_n_(0),busy_(false),quit_(false){
+	int frames;
+	pn.param("history_frames", frames, 1800);
+	pn.param("history_dir", dir_, std::string("/tmp"));
+	pn.param("history_seconds", window_, 30.0);
+	pn.param("history_post_seconds", post_, 2.0);
+	if(frames<1){
+		frames=1;
+	}
+	entries_.resize(frames);
+	snapshot_.resize(frames);
+	// fault the copy in now, the first dump would pay for it otherwise
+	memset(&snapshot_[0], 0, snapshot_.size()*sizeof(Entry));
+
+	std::vector<std::string> triggers;
+	if(!pn.getParam("history_triggers", triggers)){
+		triggers.push_back("wheeldrop");
+		triggers.push_back("cliff");
+		triggers.push_back("overcurrent");
+	}
+	for(size_t i=0; i<triggers.size(); i++){
+		if(triggers[i]=="stuck"){
+			stuck_trigger_=true;
+			continue;
+		}
+		uint32_t mask=triggerMask(triggers[i]);
+		if(mask==0){
+			ROS_WARN("unknown history trigger %s", triggers[i].c_str());
+		}
+		trigger_mask_|=mask;
+	}
+
+	ROS_INFO("sensor history: %d frames, %.0f kB", frames, frames*sizeof(Entry)/1024.0);
+	srv_=n.advertiseService("/roomba/dump_history", &SensorHistory::dump, this);
+	thread_=boost::thread(boost::bind(&SensorHistory::writer, this));
+}
+
+SensorHistory::~SensorHistory()
+{
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		quit_=true;
+	}
+	wakeup_.notify_all();
+	thread_.join();
+}
+
+uint32_t SensorHistory::triggerMask(const std::string& name)
+{
+	if(name=="bump"){
+		return SensorEvent::BUMP_RIGHT|SensorEvent::BUMP_LEFT;
+	}else if(name=="wheeldrop"){
+		return SensorEvent::WHEELDROP_RIGHT|SensorEvent::WHEELDROP_LEFT|SensorEvent::WHEELDROP_CASTER;
+	}else if(name=="cliff"){
+		return SensorEvent::CLIFF_LEFT|SensorEvent::CLIFF_FRONT_LEFT|
+			SensorEvent::CLIFF_FRONT_RIGHT|SensorEvent::CLIFF_RIGHT;
+	}else if(name=="virtual_wall"){
+		return SensorEvent::VIRTUAL_WALL;
+	}else if(name=="overcurrent"){
+		return SensorEvent::OVERCURRENT_SIDE_BRUSH|SensorEvent::OVERCURRENT_VACUUM|
+			SensorEvent::OVERCURRENT_MAIN_BRUSH|SensorEvent::OVERCURRENT_DRIVE_RIGHT|
+			SensorEvent::OVERCURRENT_DRIVE_LEFT;
+	}
+	return 0;
+}
+
+void SensorHistory::add(const Roomba500State& sens, const unsigned char* raw,
+	const geometry_msgs::Pose2D& pose, const geometry_msgs::Twist& cmd)
+{
+	// the slot is overwritten in place, nothing is allocated
+	Entry& e=entries_[count_%entries_.size()];
+	SharedStateWriter::fill(e.state, sens, true, pose, cmd);
+	e.state.frames=count_;
+	memcpy(e.raw, raw, ALL_PACKET_SIZE);
+	count_++;
+
+	uint32_t bits=e.state.contacts;
+	double now=e.state.monotonic;
+	if(has_last_ && dump_at_==0 && now>=cooldown_until_){
+		uint32_t rising=bits&~last_bits_&trigger_mask_;
+		uint32_t falling=last_bits_&~bits;
+		if(rising){
+			reason_.clear();
+			for(int i=0; i<NUM_TRIGGERS; i++){
+				if(rising&triggerMask(TRIGGER_NAMES[i])){
+					reason_+=(reason_.empty() ? "" : "-")+std::string(TRIGGER_NAMES[i]);
+				}
+			}
+			dump_at_=now+post_;
+		}else if(stuck_trigger_ && (falling&SensorEvent::STASIS) && drivingForward(sens)){
+			reason_="stuck";
+			dump_at_=now+post_;
+		}
+		if(dump_at_>0){
+			ROS_WARN("history trigger %s, dumping in %.1f sec", reason_.c_str(), post_);
+		}
+	}
+	last_bits_=bits;
+	has_last_=true;
+
+	if(dump_at_>0 && now>=dump_at_){
+		char name[64];
+		snprintf(name, sizeof(name), "/roomba_history_%.0f_", sens.header.stamp.toSec());
+		size_t n;
+		dumpAsync(dir_+name+reason_, window_+post_, n);
+		dump_at_=0;
+		cooldown_until_=now+TRIGGER_COOLDOWN;
+	}
+}
+
+// from what the robot reports, the last command may have any drive mode
+bool SensorHistory::drivingForward(const Roomba500State& sens)
+{
+	float left, right;
+	SlipDetector::requested(sens, left, right);
+	return left+right>0;
+}
+
+void SensorHistory::window(double seconds, size_t& first, size_t& n) const
+{
+	size_t kept=size();
+	first=count_-kept;
+	n=kept;
+	if(seconds<=0 || kept==0){
+		return;
+	}
+	double since=at(count_-1).state.monotonic-seconds;
+	while(n>0 && at(first).state.monotonic<since){
+		first++;
+		n--;
+	}
+}
+
+bool SensorHistory::dumpAsync(const std::string& path, double seconds, size_t& n)
+{
+	boost::mutex::scoped_lock lock(mutex_);
+	n=0;
+	if(busy_){
+		ROS_WARN("history dump to %s skipped, the previous one is still written", path.c_str());
+		return false;
+	}
+	size_t first;
+	window(seconds, first, n);
+	for(size_t i=0; i<n; i++){
+		snapshot_[i]=at(first+i);
+	}
+	snapshot_n_=n;
+	snapshot_path_=path;
+	busy_=true;
+	wakeup_.notify_all();
+	return true;
+}
+
+void SensorHistory::writer()
+{
+	boost::mutex::scoped_lock lock(mutex_);
+	while(true){
+		while(!busy_ && !quit_){
+			wakeup_.wait(lock);
+		}
+		if(!busy_){
+			return;
+		}
+		// add() leaves snapshot_ alone while busy_
+		lock.unlock();
+		std::string message;
+		if(writeEntries(snapshot_path_, snapshot_, 0, snapshot_n_, message)){
+			ROS_WARN("history dumped: %s", message.c_str());
+		}else{
+			ROS_ERROR("history dump failed: %s", message.c_str());
+		}
+		lock.lock();
+		busy_=false;
+	}
+}
+
+// entries[(first+i) % size] for i < n
+bool SensorHistory::writeEntries(const std::string& path, const std::vector<Entry>& entries,
+	size_t first, size_t n, std::string& message)
+{
+	std::string bin=path+".bin";
+	std::string csv=path+".csv";
+	FILE* fb=fopen(bin.c_str(), "wb");
+	FILE* fc=fopen(csv.c_str(), "w");
+	if(!fb || !fc){
+		if(fb) fclose(fb);
+		if(fc) fclose(fc);
+		message="cannot open "+path+".{bin,csv}";
+		return false;
+	}
+
+	fprintf(fc, "stamp,contacts,encoder_left,encoder_right,requested_left,requested_right,"
+		"voltage,current,charge,charging_state,oi_mode,ir_omni,"
+		"light_bumper_left,light_bumper_front_left,light_bumper_center_left,"
+		"light_bumper_center_right,light_bumper_front_right,light_bumper_right,"
+		"cliff_left,cliff_front_left,cliff_front_right,cliff_right,wall,x,y,theta,linear,angular\n");
+	bool ok=true;
+	for(size_t i=first; i<first+n; i++){
+		const Entry& e=entries[i%entries.size()];
+		const SharedStateData& d=e.state;
+		ok=ok && fwrite(e.raw, 1, ALL_PACKET_SIZE, fb)==(size_t)ALL_PACKET_SIZE;
+		fprintf(fc, "%.6f,%u,%u,%u,%d,%d,%u,%d,%u,%u,%u,%u,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%f,%f,%f,%f,%f\n",
+			d.stamp, d.contacts, d.encoder_left, d.encoder_right,
+			d.requested_velocity_left, d.requested_velocity_right,
+			d.voltage, d.current, d.charge, d.charging_state, d.oi_mode, d.ir_omni,
+			d.light_bumper[0], d.light_bumper[1], d.light_bumper[2],
+			d.light_bumper[3], d.light_bumper[4], d.light_bumper[5],
+			d.cliff_signal[0], d.cliff_signal[1], d.cliff_signal[2], d.cliff_signal[3],
+			d.wall_signal, d.x, d.y, d.theta, d.linear, d.angular);
+	}
+	ok=(fclose(fb)==0) && ok;
+	ok=(fclose(fc)==0) && ok;
+
+	char buf[32];
+	snprintf(buf, sizeof(buf), "%u frames to ", (unsigned)n);
+	message=std::string(ok ? "" : "write error, ")+buf+path+".{bin,csv}";
+	return ok;
+}
+
+bool SensorHistory::dump(DumpHistory::Request& req, DumpHistory::Response& res)
+{
+	if(!req.path.empty()){
+		// the result of the write is logged by the writer thread
+		size_t n;
+		res.success=dumpAsync(req.path, req.seconds, n);
+		res.frames=n;
+		res.message=res.success ? "writing to "+req.path+".{bin,csv}" : "a dump is still written, try again";
+		return true;
+	}
+
+	size_t first, n;
+	window(req.seconds, first, n);
+	res.stamps.resize(n);
+	res.raw.resize(n*ALL_PACKET_SIZE);
+	for(size_t i=0; i<n; i++){
+		const Entry& e=at(first+i);
+		res.stamps[i]=e.state.stamp;
+		memcpy(&res.raw[i*ALL_PACKET_SIZE], e.raw, ALL_PACKET_SIZE);
+	}
+	res.frames=n;
+	res.success=true;
+	return true;
+}
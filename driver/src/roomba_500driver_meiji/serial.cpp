@@ -34,24 +34,40 @@ using namespace std;
 //#define DEBUG
 
 Serial::Serial(int baudrate, const char* modemdevice, int vmin, int lflag)
+:fd_(-1),device_(modemdevice),baudrate_(baudrate)
+{
+	// a missing device is not fatal, the caller can retry with open()
+	open();
+}
+
+bool Serial::open()
 {
-#if 1
 		struct termios toptions;
 
-		fd_ = open(modemdevice, O_RDWR | O_NOCTTY | O_NDELAY );
+		close();
+
+		// B0 would hang up the line
+		if (baudrate_ == B0) {
+			fprintf(stderr, "roomba_init_serialport: Unsupported baud rate\n");
+			return false;
+		}
+
+		fd_ = ::open(device_.c_str(), O_RDWR | O_NOCTTY | O_NDELAY );
 		if (fd_ == -1)  {     // Could not open the port.
 			perror("roomba_init_serialport: Unable to open port ");
-			exit(-1);
+			return false;
     }
 
 		tcgetattr(fd_, &oldtio_);
 		if (tcgetattr(fd_, &toptions) < 0) {
 			perror("roomba_init_serialport: Couldn't get term attributes");
-				exit(-1);
+			::close(fd_);
+			fd_ = -1;
+			return false;
 		}
 
-		cfsetispeed(&toptions, baudrate);
-		cfsetospeed(&toptions, baudrate);
+		cfsetispeed(&toptions, baudrate_);
+		cfsetospeed(&toptions, baudrate_);
 
 		// 8N1
 		toptions.c_cflag &= ~PARENB;
@@ -72,28 +88,39 @@ Serial::Serial(int baudrate, const char* modemdevice, int vmin, int lflag)
 
 		if( tcsetattr(fd_, TCSANOW, &toptions) < 0) {
 			perror("roomba_init_serialport: Couldn't set term attributes");
-			exit(-1);
+			::close(fd_);
+			fd_ = -1;
+			return false;
 		}
-#endif
 
+		return true;
+}
+
+void Serial::close()
+{
+	if(fd_ < 0){
+		return;
+	}
+	tcsetattr(fd_,TCSANOW,&oldtio_);
+	::close(fd_);
+	fd_ = -1;
 }
 
 
 Serial::~Serial()
 {
-	tcsetattr(fd_,TCSANOW,&oldtio_);
-	close(fd_);
+	close();
 }
 
 
 int Serial::read(unsigned char* p, int len)
 {
-	return ::read(fd_, p, len);
+	return readFd(fd_, p, len);
 }
 
 int Serial::write(const unsigned char* p, int len)
 {
-	return ::write(fd_, p, len);
+	return writeFd(fd_, p, len);
 }
 
 void Serial::setVmin(int vmin) {
@@ -118,6 +145,28 @@ void Serial::setRts(int sw)
 	ioctl(fd_, TIOCMSET, &status); /* set the serial port status */
 }
 
+void Serial::drain()
+{
+	tcdrain(fd_);
+}
+
+int Serial::toTermiosBaud(int bps)
+{
+	switch(bps){
+		case 300:		return B300;
+		case 600:		return B600;
+		case 1200:		return B1200;
+		case 2400:		return B2400;
+		case 4800:		return B4800;
+		case 9600:		return B9600;
+		case 19200:		return B19200;
+		case 38400:		return B38400;
+		case 57600:		return B57600;
+		case 115200:	return B115200;
+		default:		return B0;
+	}
+}
+
 #ifdef DEBUG
 int main()
 {
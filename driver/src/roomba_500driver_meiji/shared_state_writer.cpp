@@ -0,0 +1,142 @@
+//---------------------------< /-/ AMSL /-/ >------------------------------
+/**
+ * file         :       shared_state_writer.cpp
+ *
+ *
+ * Environment  :       g++
+ *
+ */
+//-----------------------------------------------------------------------------
+
+#include "roomba_500driver_meiji/shared_state_writer.h"
+#include "roomba_500driver_meiji/sensor_events.h"
+#include "roomba_500driver_meiji/timer.h"
+#include "ros/ros.h"
+
+#include <errno.h>
+
+SharedStateWriter::SharedStateWriter(const std::string& name)
+:name_(name),state_(NULL){
+	int fd=shm_open(name.c_str(), O_CREAT|O_RDWR, 0644);
+	if(fd<0){
+		ROS_ERROR("shm_open %s: %s", name.c_str(), strerror(errno));
+		return;
+	}
+	if(ftruncate(fd, sizeof(SharedState))<0){
+		ROS_ERROR("ftruncate %s: %s", name.c_str(), strerror(errno));
+		::close(fd);
+		return;
+	}
+	void* p=mmap(NULL, sizeof(SharedState), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);
+	if(p==MAP_FAILED){
+		ROS_ERROR("mmap %s: %s", name.c_str(), strerror(errno));
+		return;
+	}
+
+	state_=(SharedState*)p;
+	// readers of an older driver may still have it mapped. the clear is a
+	// write like any other, so they retry instead of taking a torn copy.
+	// an odd sequence left by a crashed writer is moved on to even first,
+	// never back
+	if(state_->sequence&1){
+		state_->sequence++;
+	}
+	begin();
+	state_->magic=0;
+	__sync_synchronize();
+	memset(&state_->data, 0, sizeof(state_->data));
+	state_->size=sizeof(SharedStateData);
+	state_->version=SHARED_STATE_VERSION;
+	end();
+	__sync_synchronize();
+	state_->magic=SHARED_STATE_MAGIC;
+	ROS_INFO("state mirrored to shared memory %s", name.c_str());
+}
+
+SharedStateWriter::~SharedStateWriter()
+{
+	if(!state_){
+		return;
+	}
+	setConnected(false);
+	munmap(state_, sizeof(SharedState));
+	shm_unlink(name_.c_str());
+}
+
+void SharedStateWriter::begin()
+{
+	state_->sequence++;
+	__sync_synchronize();
+}
+
+void SharedStateWriter::end()
+{
+	__sync_synchronize();
+	state_->sequence++;
+}
+
+void SharedStateWriter::setConnected(bool connected)
+{
+	if(!state_ || state_->data.connected==(connected ? 1 : 0)){
+		return;
+	}
+	begin();
+	state_->data.connected=connected ? 1 : 0;
+	end();
+}
+
+void SharedStateWriter::publish(const roomba_500driver_meiji::Roomba500State& sens, bool connected,
+	const geometry_msgs::Pose2D& pose, const geometry_msgs::Twist& cmd)
+{
+	if(!state_){
+		return;
+	}
+
+	begin();
+	uint64_t frames=state_->data.frames;
+	fill(state_->data, sens, connected, pose, cmd);
+	state_->data.frames=frames+1;
+	end();
+}
+
+void SharedStateWriter::fill(SharedStateData& d, const roomba_500driver_meiji::Roomba500State& sens,
+	bool connected, const geometry_msgs::Pose2D& pose, const geometry_msgs::Twist& cmd)
+{
+	d.stamp=sens.header.stamp.toSec();
+	d.monotonic=Timer::now();
+
+	d.contacts=SensorEvents::pack(sens);
+	d.encoder_left=sens.encoder_counts.left;
+	d.encoder_right=sens.encoder_counts.right;
+	d.light_bumper[0]=sens.light_bumper.left;
+	d.light_bumper[1]=sens.light_bumper.front_left;
+	d.light_bumper[2]=sens.light_bumper.center_left;
+	d.light_bumper[3]=sens.light_bumper.center_right;
+	d.light_bumper[4]=sens.light_bumper.front_right;
+	d.light_bumper[5]=sens.light_bumper.right;
+	d.cliff_signal[0]=sens.cliff.left_signal;
+	d.cliff_signal[1]=sens.cliff.front_left_signal;
+	d.cliff_signal[2]=sens.cliff.front_right_signal;
+	d.cliff_signal[3]=sens.cliff.right_signal;
+	d.wall_signal=sens.wall_signal;
+	d.requested_velocity_left=sens.requested_wheel_velocity.left;
+	d.requested_velocity_right=sens.requested_wheel_velocity.right;
+	d.current=sens.current;
+	d.voltage=sens.voltage;
+	d.charge=sens.charge;
+	d.capacity=sens.capacity;
+	d.charging_state=sens.charging_state;
+	d.oi_mode=sens.open_interface_mode;
+	d.temperature=(int8_t)sens.temperature;
+	d.connected=connected ? 1 : 0;
+	d.ir_left=sens.opcode.left;
+	d.ir_right=sens.opcode.right;
+	d.ir_omni=sens.remote_control_command;
+
+	d.x=pose.x;
+	d.y=pose.y;
+	d.theta=pose.theta;
+	d.linear=cmd.linear.x;
+	d.angular=cmd.angular.z;
+}
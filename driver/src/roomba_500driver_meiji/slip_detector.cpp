@@ -0,0 +1,141 @@
+//---------------------------< /-/ AMSL /-/ >------------------------------
+/**
+ * file         :       slip_detector.cpp
+ *
+ *
+ * Environment  :       g++
+ *
+ */
+//-----------------------------------------------------------------------------
+
+#include "roomba_500driver_meiji/slip_detector.h"
+#include "roomba_500driver_meiji/timer.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace roomba_500driver_meiji;
+
+static const double TICKS_PER_MM=2.270;
+static const double HALF_WHEEL_BASE=0.5*235;	// mm
+static const double MAX_GAP=0.5;				// sec, longer gaps restart the smoothing
+
+static const uint8_t SLIP_FLAG[]={ SlipEvent::SLIP_LEFT, SlipEvent::SLIP_RIGHT };
+static const uint8_t STALL_FLAG[]={ SlipEvent::STALL_LEFT, SlipEvent::STALL_RIGHT };
+
+SlipDetector::SlipDetector(ros::NodeHandle& n, ros::NodeHandle& pn)
+:last_time_(0),initialized_(false),flags_(0),scale_(1){
+	pn.param("slip_smoothing", gain_, 0.3);
+	pn.param("slip_min_speed", min_speed_, 40.0);
+	pn.param("slip_ratio", slip_ratio_, 0.3);
+	pn.param("slip_stall_ratio", stall_ratio_, 0.2);
+	pn.param("slip_time", hold_time_, 0.3);
+	pn.param("slip_covariance_scale", slip_scale_, 10.0);
+	pn.param("stall_covariance_scale", stall_scale_, 1000.0);
+	reset();
+
+	pub_=n.advertise<SlipEvent>("/roomba/slip", 10);
+}
+
+void SlipDetector::reset()
+{
+	initialized_=false;
+	for(int i=0; i<NUM_WHEELS; i++){
+		req_[i]=meas_[i]=0;
+		slip_for_[i]=stall_for_[i]=0;
+	}
+	no_progress_for_=0;
+}
+
+// wheel speeds of the last DRIVE DIRECT, or of the last DRIVE when those are zero
+void SlipDetector::requested(const Roomba500State& sens, float& left, float& right)
+{
+	left=sens.requested_wheel_velocity.left;
+	right=sens.requested_wheel_velocity.right;
+	if(left!=0 || right!=0){
+		return;
+	}
+	float v=sens.requested_velocity;
+	short radius=sens.requested_radius;
+	if(v==0 || radius==(short)0x8000 || radius==0x7fff){
+		left=right=v;
+	}else if(radius==1 || radius==-1){
+		// turn in place
+		left=-radius*v;
+		right=radius*v;
+	}else{
+		left=v*(radius-HALF_WHEEL_BASE)/radius;
+		right=v*(radius+HALF_WHEEL_BASE)/radius;
+	}
+}
+
+void SlipDetector::update(const Roomba500State& sens, int d_enc_left, int d_enc_right)
+{
+	double now=Timer::now();
+	double dt=now-last_time_;
+	last_time_=now;
+	if(!initialized_ || dt<=0 || dt>MAX_GAP){
+		reset();
+		initialized_=true;
+		return;
+	}
+
+	float req[NUM_WHEELS], meas[NUM_WHEELS];
+	requested(sens, req[LEFT], req[RIGHT]);
+	meas[LEFT]=d_enc_left/TICKS_PER_MM/dt;
+	meas[RIGHT]=d_enc_right/TICKS_PER_MM/dt;
+
+	uint8_t flags=0;
+	double scale=1;
+	for(int i=0; i<NUM_WHEELS; i++){
+		req_[i]+=gain_*(req[i]-req_[i]);
+		meas_[i]+=gain_*(meas[i]-meas_[i]);
+
+		float r=std::fabs(req_[i]);
+		if(r<min_speed_){
+			slip_for_[i]=stall_for_[i]=0;
+			continue;
+		}
+		float err=std::fabs(meas_[i]-req_[i])/r;
+		bool stalled=(meas_[i]*req_[i]<=0) || std::fabs(meas_[i])<stall_ratio_*r;
+		slip_for_[i]=(err>slip_ratio_) ? slip_for_[i]+dt : 0;
+		stall_for_[i]=stalled ? stall_for_[i]+dt : 0;
+
+		if(stall_for_[i]>=hold_time_){
+			flags|=STALL_FLAG[i];
+			scale=std::max(scale, stall_scale_);
+		}else if(slip_for_[i]>=hold_time_){
+			flags|=SLIP_FLAG[i];
+			// grows with the speed error
+			scale=std::max(scale, 1+(slip_scale_-1)*std::min(1.0f, err));
+		}
+	}
+
+	// stasis is only meaningful while driving forward
+	bool forward=req_[LEFT]>min_speed_ && req_[RIGHT]>min_speed_;
+	no_progress_for_=(forward && !sens.stasis) ? no_progress_for_+dt : 0;
+	if(no_progress_for_>=hold_time_){
+		flags|=SlipEvent::NO_PROGRESS;
+		scale=std::max(scale, stall_scale_);
+	}
+
+	scale_=scale;
+	if(flags!=flags_){
+		SlipEvent ev;
+		ev.header=sens.header;
+		ev.flags=flags;
+		ev.rising=flags&~flags_;
+		ev.falling=flags_&~flags;
+		ev.requested_left=req_[LEFT];
+		ev.requested_right=req_[RIGHT];
+		ev.measured_left=meas_[LEFT];
+		ev.measured_right=meas_[RIGHT];
+		ev.covariance_scale=scale_;
+		pub_.publish(ev);
+		if(ev.rising){
+			ROS_WARN("wheel slip flags 0x%02x, requested %.0f/%.0f mm/s, measured %.0f/%.0f mm/s",
+				flags, req_[LEFT], req_[RIGHT], meas_[LEFT], meas_[RIGHT]);
+		}
+		flags_=flags;
+	}
+}
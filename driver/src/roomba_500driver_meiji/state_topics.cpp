@@ -0,0 +1,104 @@
+//---------------------------< /-/ AMSL /-/ >------------------------------
+/**
+ * file         :       state_topics.cpp
+ *
+ *
+ * Environment  :       g++
+ *
+ */
+//-----------------------------------------------------------------------------
+
+#include "roomba_500driver_meiji/state_topics.h"
+
+#include <roomba_500driver_meiji/ContactState.h>
+#include <roomba_500driver_meiji/LightBumperState.h>
+#include <roomba_500driver_meiji/EncoderState.h>
+#include <roomba_500driver_meiji/BatteryState.h>
+#include <roomba_500driver_meiji/ButtonState.h>
+
+using namespace roomba_500driver_meiji;
+
+static const char* TOPIC_NAMES[StateTopics::T_NUM]={
+	"contact", "light_bumper", "encoders", "battery", "buttons"
+};
+
+// battery values change slowly, so they go out less often by default
+static const int DEFAULT_DIVIDERS[StateTopics::T_NUM]={1, 1, 1, 10, 1};
+
+StateTopics::StateTopics(ros::NodeHandle& n, ros::NodeHandle& pn, const std::string& prefix)
+:cycle_(0){
+	pub_[T_CONTACT]=n.advertise<ContactState>(prefix+TOPIC_NAMES[T_CONTACT], 100);
+	pub_[T_LIGHT_BUMPER]=n.advertise<LightBumperState>(prefix+TOPIC_NAMES[T_LIGHT_BUMPER], 100);
+	pub_[T_ENCODERS]=n.advertise<EncoderState>(prefix+TOPIC_NAMES[T_ENCODERS], 100);
+	pub_[T_BATTERY]=n.advertise<BatteryState>(prefix+TOPIC_NAMES[T_BATTERY], 100);
+	pub_[T_BUTTONS]=n.advertise<ButtonState>(prefix+TOPIC_NAMES[T_BUTTONS], 100);
+
+	for(int i=0; i<T_NUM; i++){
+		pn.param(std::string(TOPIC_NAMES[i])+"_divider", divider_[i], DEFAULT_DIVIDERS[i]);
+		if(divider_[i]<1){
+			divider_[i]=1;
+		}
+	}
+}
+
+bool StateTopics::due(TOPIC t)
+{
+	return (cycle_%divider_[t])==0 && pub_[t].getNumSubscribers()>0;
+}
+
+void StateTopics::publish(const Roomba500State& sens)
+{
+	if(due(T_CONTACT)){
+		ContactState msg;
+		msg.header=sens.header;
+		msg.bump=sens.bump;
+		msg.wheeldrop=sens.wheeldrop;
+		msg.wall=sens.wall;
+		msg.cliff=sens.cliff;
+		msg.virtual_wall=sens.virtual_wall;
+		pub_[T_CONTACT].publish(msg);
+	}
+
+	if(due(T_LIGHT_BUMPER)){
+		LightBumperState msg;
+		msg.header=sens.header;
+		msg.light_bumper=sens.light_bumper;
+		pub_[T_LIGHT_BUMPER].publish(msg);
+	}
+
+	if(due(T_ENCODERS)){
+		EncoderState msg;
+		msg.header=sens.header;
+		msg.encoder_counts=sens.encoder_counts;
+		msg.requested_wheel_velocity=sens.requested_wheel_velocity;
+		msg.requested_velocity=sens.requested_velocity;
+		msg.requested_radius=sens.requested_radius;
+		msg.distance=sens.distance;
+		msg.angle=sens.angle;
+		pub_[T_ENCODERS].publish(msg);
+	}
+
+	if(due(T_BATTERY)){
+		BatteryState msg;
+		msg.header=sens.header;
+		msg.charging_state=sens.charging_state;
+		msg.charger_available=sens.charger_available;
+		msg.voltage=sens.voltage;
+		msg.current=sens.current;
+		msg.temperature=sens.temperature;
+		msg.charge=sens.charge;
+		msg.capacity=sens.capacity;
+		pub_[T_BATTERY].publish(msg);
+	}
+
+	if(due(T_BUTTONS)){
+		ButtonState msg;
+		msg.header=sens.header;
+		msg.buttons=sens.buttons;
+		msg.remote_control_command=sens.remote_control_command;
+		msg.opcode=sens.opcode;
+		pub_[T_BUTTONS].publish(msg);
+	}
+
+	cycle_++;
+}
@@ -0,0 +1,160 @@
+//---------------------------< /-/ AMSL /-/ >------------------------------
+/**
+ * file         :       tcp_transport.cpp
+ *
+ *
+ * Environment  :       g++
+ *
+ */
+//-----------------------------------------------------------------------------
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "roomba_500driver_meiji/tcp_transport.h"
+#include "roomba_500driver_meiji/timer.h"
+
+#include <string>
+
+TcpTransport::TcpTransport(const char* address)
+:fd_(-1),address_(address)
+{
+	// an unreachable bridge is not fatal, the caller can retry with open()
+	open();
+}
+
+bool TcpTransport::open()
+{
+	close();
+
+	std::string::size_type colon=address_.rfind(':');
+	if(colon==std::string::npos){
+		fprintf(stderr, "tcp transport: address must be host:port (%s)\n", address_.c_str());
+		return false;
+	}
+	std::string host=address_.substr(0, colon);
+	std::string port=address_.substr(colon+1);
+
+	struct addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family=AF_UNSPEC;
+	hints.ai_socktype=SOCK_STREAM;
+
+	struct addrinfo* res;
+	int err=getaddrinfo(host.c_str(), port.c_str(), &hints, &res);
+	if(err!=0){
+		fprintf(stderr, "tcp transport: %s: %s\n", address_.c_str(), gai_strerror(err));
+		return false;
+	}
+
+	// all addresses share the timeout
+	double deadline=Timer::now()+TCP_CONNECT_TIMEOUT;
+	for(struct addrinfo* ai=res; ai; ai=ai->ai_next){
+		fd_=socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+		if(fd_<0){
+			continue;
+		}
+		if(connectFd(fd_, ai->ai_addr, ai->ai_addrlen, deadline)){
+			break;
+		}
+		::close(fd_);
+		fd_=-1;
+	}
+	freeaddrinfo(res);
+
+	if(fd_<0){
+		perror("tcp transport: Unable to connect ");
+		return false;
+	}
+
+	// commands are a few bytes each, do not let Nagle hold them back
+	int one=1;
+	setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	return true;
+}
+
+// non-blocking connect, so an unreachable bridge does not hold the
+// driver loop until the kernel gives up. fd stays non-blocking
+bool TcpTransport::connectFd(int fd, const struct sockaddr* addr, socklen_t len, double deadline)
+{
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL)|O_NONBLOCK);
+	if(connect(fd, addr, len)==0){
+		return true;
+	}
+	if(errno!=EINPROGRESS){
+		return false;
+	}
+
+	struct pollfd pfd;
+	pfd.fd=fd;
+	pfd.events=POLLOUT;
+	int n;
+	do{
+		int ms=(int)((deadline-Timer::now())*1000);
+		if(ms<=0){
+			errno=ETIMEDOUT;
+			return false;
+		}
+		n=poll(&pfd, 1, ms);
+	}while(n<0 && errno==EINTR);
+	if(n<=0){
+		errno=(n==0) ? ETIMEDOUT : errno;
+		return false;
+	}
+
+	int err=0;
+	socklen_t err_len=sizeof(err);
+	if(getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &err_len)<0 || err!=0){
+		errno=err;
+		return false;
+	}
+	return true;
+}
+
+void TcpTransport::close()
+{
+	if(fd_>=0){
+		::close(fd_);
+		fd_=-1;
+	}
+}
+
+TcpTransport::~TcpTransport()
+{
+	close();
+}
+
+int TcpTransport::read(unsigned char* p, int len)
+{
+	if(len<=0){
+		return 0;
+	}
+
+	int n;
+	do{
+		n=::read(fd_, p, len);
+	}while(n<0 && errno==EINTR);
+
+	if(n==0){
+		// the bridge closed the connection
+		return -1;
+	}
+	if(n<0 && (errno==EAGAIN || errno==EWOULDBLOCK)){
+		return 0;
+	}
+	return n;
+}
+
+int TcpTransport::write(const unsigned char* p, int len)
+{
+	return writeFd(fd_, p, len);
+}
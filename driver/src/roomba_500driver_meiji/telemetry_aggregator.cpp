@@ -0,0 +1,128 @@
+//---------------------------< /-/ AMSL /-/ >------------------------------
+/**
+ * file         :       telemetry_aggregator.cpp
+ *
+ *
+ * Environment  :       g++
+ *
+ */
+//-----------------------------------------------------------------------------
+
+#include "roomba_500driver_meiji/telemetry_aggregator.h"
+
+using namespace roomba_500driver_meiji;
+
+TelemetryAggregator::TelemetryAggregator(ros::NodeHandle& n, ros::NodeHandle& pn)
+:count_(0),drawn_mah_(0){
+	double rate;
+	pn.param("telemetry_rate", rate, 1.0);
+	if(rate<=0){
+		rate=1.0;
+	}
+	period_=ros::Duration(1.0/rate);
+	reset();
+
+	pub_=n.advertise<AnalogTelemetry>("/roomba/telemetry", 10);
+}
+
+void TelemetryAggregator::update(const Roomba500State& sens)
+{
+	add(sens);
+
+	if(sens.header.stamp-last_pub_ < period_){
+		return;
+	}
+	last_pub_=sens.header.stamp;
+
+	if(pub_.getNumSubscribers()>0){
+		AnalogTelemetry msg;
+		msg.header=sens.header;
+		fill(msg);
+		pub_.publish(msg);
+	}
+	reset();
+}
+
+void TelemetryAggregator::reset()
+{
+	count_=0;
+	for(int i=0; i<S_NUM; i++){
+		min_[i]=max_[i]=last_[i]=0;
+		sum_[i]=0;
+	}
+}
+
+void TelemetryAggregator::add(const Roomba500State& sens)
+{
+	float v[S_NUM];
+	v[S_VOLTAGE]=sens.voltage;
+	v[S_CURRENT]=sens.current;
+	v[S_WALL]=sens.wall_signal;
+	v[S_CLIFF_LEFT]=sens.cliff.left_signal;
+	v[S_CLIFF_FRONT_LEFT]=sens.cliff.front_left_signal;
+	v[S_CLIFF_FRONT_RIGHT]=sens.cliff.front_right_signal;
+	v[S_CLIFF_RIGHT]=sens.cliff.right_signal;
+	v[S_LB_LEFT]=sens.light_bumper.left;
+	v[S_LB_FRONT_LEFT]=sens.light_bumper.front_left;
+	v[S_LB_CENTER_LEFT]=sens.light_bumper.center_left;
+	v[S_LB_CENTER_RIGHT]=sens.light_bumper.center_right;
+	v[S_LB_FRONT_RIGHT]=sens.light_bumper.front_right;
+	v[S_LB_RIGHT]=sens.light_bumper.right;
+
+	// current is in mA, negative while discharging.
+	// long gaps (link down) are not integrated
+	if(!last_stamp_.isZero()){
+		double dt=(sens.header.stamp-last_stamp_).toSec();
+		if(dt>0 && dt<1.0){
+			drawn_mah_-=sens.current*dt/3600.0;
+		}
+	}
+	last_stamp_=sens.header.stamp;
+
+	if(count_==0){
+		first_stamp_=sens.header.stamp;
+		for(int i=0; i<S_NUM; i++){
+			min_[i]=max_[i]=v[i];
+		}
+	}
+	for(int i=0; i<S_NUM; i++){
+		if(v[i]<min_[i]) min_[i]=v[i];
+		if(v[i]>max_[i]) max_[i]=v[i];
+		sum_[i]+=v[i];
+		last_[i]=v[i];
+	}
+	count_++;
+}
+
+void TelemetryAggregator::stats(SIGNAL s, SignalStats& out) const
+{
+	out.min=min_[s];
+	out.max=max_[s];
+	out.mean=count_>0 ? sum_[s]/count_ : 0;
+	out.last=last_[s];
+}
+
+void TelemetryAggregator::fill(AnalogTelemetry& msg) const
+{
+	msg.samples=count_;
+	msg.window=0;
+	if(count_>1){
+		msg.window=(last_stamp_-first_stamp_).toSec();
+	}
+
+	stats(S_VOLTAGE, msg.voltage);
+	stats(S_CURRENT, msg.current);
+	stats(S_WALL, msg.wall_signal);
+	stats(S_CLIFF_LEFT, msg.cliff_left_signal);
+	stats(S_CLIFF_FRONT_LEFT, msg.cliff_front_left_signal);
+	stats(S_CLIFF_FRONT_RIGHT, msg.cliff_front_right_signal);
+	stats(S_CLIFF_RIGHT, msg.cliff_right_signal);
+	stats(S_LB_LEFT, msg.light_bumper_left);
+	stats(S_LB_FRONT_LEFT, msg.light_bumper_front_left);
+	stats(S_LB_CENTER_LEFT, msg.light_bumper_center_left);
+	stats(S_LB_CENTER_RIGHT, msg.light_bumper_center_right);
+	stats(S_LB_FRONT_RIGHT, msg.light_bumper_front_right);
+	stats(S_LB_RIGHT, msg.light_bumper_right);
+
+	msg.drawn_mah=drawn_mah_;
+}
@@ -0,0 +1,137 @@
+//---------------------------< /-/ AMSL /-/ >------------------------------
+/**
+ * file         :       trace.cpp
+ *
+ *
+ * Environment  :       g++
+ *
+ */
+//-----------------------------------------------------------------------------
+
+#include "roomba_500driver_meiji/trace.h"
+#include "roomba_500driver_meiji/timer.h"
+
+#include <boost/thread/mutex.hpp>
+#include <stdio.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+struct Span {
+	const char* name;
+	double begin;
+	double end;
+};
+
+// one per thread, allocated on its first span and kept until exit so
+// that stop() can still read it. sequence is odd while the thread is in
+// record()
+struct Buffer {
+	Buffer(int tid):spans(Trace::CAPACITY),count(0),tid(tid),sequence(0){}
+	std::vector<Span> spans;
+	unsigned long count;
+	int tid;
+	volatile unsigned long sequence;
+};
+
+boost::mutex buffers_mutex;
+std::vector<Buffer*> buffers;
+std::string trace_path;
+double trace_origin=0;
+
+__thread Buffer* local_buffer=NULL;
+
+Buffer* threadBuffer()
+{
+	if(!local_buffer){
+		boost::mutex::scoped_lock lock(buffers_mutex);
+		local_buffer=new Buffer(buffers.size()+1);
+		buffers.push_back(local_buffer);
+	}
+	return local_buffer;
+}
+
+// after enabled_ is cleared, waits for the threads still in record().
+// called with buffers_mutex held
+void quiesce()
+{
+	__sync_synchronize();
+	for(size_t i=0; i<buffers.size(); i++){
+		while(buffers[i]->sequence&1){
+			usleep(100);
+		}
+	}
+	__sync_synchronize();
+}
+
+}	// namespace
+
+volatile bool Trace::enabled_=false;
+
+void Trace::start(const std::string& path)
+{
+	boost::mutex::scoped_lock lock(buffers_mutex);
+	enabled_=false;
+	quiesce();
+	for(size_t i=0; i<buffers.size(); i++){
+		buffers[i]->count=0;
+	}
+	trace_path=path;
+	trace_origin=Timer::now();
+	enabled_=true;
+}
+
+bool Trace::stop()
+{
+	if(!enabled_){
+		return true;
+	}
+	enabled_=false;
+
+	// the rings are read below without the writers
+	boost::mutex::scoped_lock lock(buffers_mutex);
+	quiesce();
+	FILE* fp=fopen(trace_path.c_str(), "w");
+	if(!fp){
+		return false;
+	}
+	fprintf(fp, "{\"traceEvents\":[\n");
+	bool first=true;
+	for(size_t i=0; i<buffers.size(); i++){
+		const Buffer& b=*buffers[i];
+		unsigned long n=b.count<(unsigned long)CAPACITY ? b.count : CAPACITY;
+		for(unsigned long k=b.count-n; k<b.count; k++){
+			const Span& s=b.spans[k%CAPACITY];
+			fprintf(fp, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.1f,\"dur\":%.1f}",
+				first ? "" : ",\n", s.name, b.tid,
+				(s.begin-trace_origin)*1e6, (s.end-s.begin)*1e6);
+			first=false;
+		}
+	}
+	fprintf(fp, "\n],\"displayTimeUnit\":\"ms\"}\n");
+	return fclose(fp)==0;
+}
+
+double Trace::now()
+{
+	return Timer::now();
+}
+
+void Trace::record(const char* name, double begin, double end)
+{
+	Buffer* b=threadBuffer();
+	// a span that began before stop() is dropped, quiesce() either sees
+	// the odd sequence or this sees enabled_ cleared
+	b->sequence++;
+	__sync_synchronize();
+	if(enabled_){
+		Span& s=b->spans[b->count%CAPACITY];
+		s.name=name;
+		s.begin=begin;
+		s.end=end;
+		b->count++;
+	}
+	__sync_synchronize();
+	b->sequence++;
+}
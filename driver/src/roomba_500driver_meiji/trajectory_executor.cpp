@@ -0,0 +1,182 @@
+//---------------------------< /-/ AMSL /-/ >------------------------------
+/**
+ * file         :       trajectory_executor.cpp
+ *
+ *
+ * Environment  :       g++
+ *
+ */
+//-----------------------------------------------------------------------------
+
+#include "roomba_500driver_meiji/trajectory_executor.h"
+#include "roomba_500driver_meiji/timer.h"
+#include "ros/ros.h"
+
+#include <boost/bind.hpp>
+#include <algorithm>
+#include <cmath>
+
+using namespace roomba_500driver_meiji;
+
+TrajectoryExecutor::TrajectoryExecutor(roombaSci* roomba, boost::mutex& io_mutex)
+:roomba_(roomba),io_mutex_(io_mutex),generation_(0),has_work_(false),running_(false),quit_(false),
+distance_(0),angle_(0){
+	// started last, every member above is ready
+	thread_=boost::thread(boost::bind(&TrajectoryExecutor::run, this));
+}
+
+TrajectoryExecutor::~TrajectoryExecutor()
+{
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		quit_=true;
+		generation_++;
+	}
+	wakeup_.notify_all();
+	thread_.join();
+}
+
+void TrajectoryExecutor::start(const Trajectory& trajectory)
+{
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		trajectory_=trajectory;
+		generation_++;
+		has_work_=true;
+	}
+	wakeup_.notify_all();
+}
+
+void TrajectoryExecutor::cancel()
+{
+	boost::mutex::scoped_lock lock(mutex_);
+	if(running_ || has_work_){
+		generation_++;
+		has_work_=false;
+	}
+}
+
+bool TrajectoryExecutor::running() const
+{
+	boost::mutex::scoped_lock lock(mutex_);
+	return running_ || has_work_;
+}
+
+void TrajectoryExecutor::addOdometry(float distance, float angle)
+{
+	boost::mutex::scoped_lock lock(mutex_);
+	distance_+=distance;
+	angle_+=angle;
+}
+
+void TrajectoryExecutor::run()
+{
+	while(true){
+		Trajectory trajectory;
+		unsigned long generation;
+		{
+			boost::mutex::scoped_lock lock(mutex_);
+			while(!has_work_ && !quit_){
+				wakeup_.wait(lock);
+			}
+			if(quit_){
+				return;
+			}
+			trajectory=trajectory_;
+			generation=generation_;
+			has_work_=false;
+			running_=true;
+		}
+
+		double start=Timer::now();
+		bool done=execute(trajectory, generation);
+		if(done){
+			ROS_INFO("trajectory of %d segments done in %.3f sec",
+				(int)trajectory.segments.size(), Timer::now()-start);
+		}else{
+			ROS_INFO("trajectory pre-empted after %.3f sec", Timer::now()-start);
+		}
+
+		boost::mutex::scoped_lock lock(mutex_);
+		running_=false;
+	}
+}
+
+bool TrajectoryExecutor::execute(const Trajectory& trajectory, unsigned long generation)
+{
+	if(trajectory.segments.empty()){
+		send(generation, 0, 0);
+		return true;
+	}
+
+	// when the current segment started, planned or measured
+	double t=Timer::now();
+	for(size_t i=0; i<trajectory.segments.size(); i++){
+		const TrajectorySegment& seg=trajectory.segments[i];
+		if(seg.duration<=0){
+			ROS_WARN("trajectory segment %d has no duration, skipped", (int)i);
+			continue;
+		}
+
+		if(!send(generation, seg.velocity, seg.yawrate)){
+			return false;
+		}
+		ROS_DEBUG("trajectory segment %d started %.1f ms late", (int)i, (Timer::now()-t)*1000);
+
+		double deadline=t+seg.duration;
+		bool ended_early=false;
+		while(true){
+			double now=Timer::now();
+			if(now>=deadline){
+				break;
+			}
+			{
+				boost::mutex::scoped_lock lock(mutex_);
+				if(generation!=generation_){
+					return false;
+				}
+				if(reached(seg)){
+					ended_early=true;
+					break;
+				}
+			}
+			Timer::sleepUntil(std::min(deadline, now+TRAJECTORY_POLL));
+		}
+		t=ended_early ? Timer::now() : deadline;
+	}
+
+	if(trajectory.stop_at_end){
+		return send(generation, 0, 0);
+	}
+	return true;
+}
+
+bool TrajectoryExecutor::send(unsigned long generation, float velocity, float yawrate)
+{
+	// a command that cancels us takes io_mutex_ first, so it is either
+	// seen here or sent after this one
+	boost::mutex::scoped_lock io_lock(io_mutex_);
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		if(generation!=generation_){
+			return false;
+		}
+		distance_=0;
+		angle_=0;
+	}
+	// without mutex_, addOdometry() does not wait for COMMAND_WAIT
+	roomba_->driveDirect(velocity, yawrate);
+	return true;
+}
+
+// called with mutex_ held
+bool TrajectoryExecutor::reached(const TrajectorySegment& seg) const
+{
+	if(seg.distance>0 && std::fabs(distance_)>=seg.distance){
+		return true;
+	}
+	if(seg.angle>0 && std::fabs(angle_)>=seg.angle){
+		return true;
+	}
+	return false;
+}
@@ -0,0 +1,123 @@
+//---------------------------< /-/ AMSL /-/ >------------------------------
+/**
+ * file         :       transport.cpp
+ *
+ *
+ * Environment  :       g++
+ *
+ */
+//-----------------------------------------------------------------------------
+
+#include <poll.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "roomba_500driver_meiji/transport.h"
+#include "roomba_500driver_meiji/timer.h"
+#include "roomba_500driver_meiji/serial.h"
+#include "roomba_500driver_meiji/tcp_transport.h"
+#include "roomba_500driver_meiji/loopback_transport.h"
+
+bool Transport::waitReadable(float sec)
+{
+	ROOMBA_TRACE_SCOPE("serial_wait");
+	struct pollfd pfd;
+	pfd.fd=fd();
+	pfd.events=POLLIN;
+	pfd.revents=0;
+
+	int ms=(int)(sec*1000);
+	if(ms<0){
+		ms=0;
+	}
+
+	int ret;
+	do{
+		ret=poll(&pfd, 1, ms);
+	}while(ret<0 && errno==EINTR);
+
+	return ret>0;
+}
+
+int Transport::readFull(unsigned char* p, int len, float timeout)
+{
+	double deadline=Timer::now()+timeout;
+	int got=0;
+
+	while(got<len){
+		int n=read(p+got, len-got);
+		if(n<0){
+			return got>0 ? got : -1;
+		}
+		got+=n;
+		if(got==len){
+			break;
+		}
+
+		double left=deadline-Timer::now();
+		if(left<=0 || !waitReadable(left)){
+			break;
+		}
+	}
+	return got;
+}
+
+void Transport::flushInput()
+{
+	unsigned char buf[256];
+	while(read(buf, sizeof(buf))>0){
+	}
+}
+
+Transport* Transport::create(const char* dev, int baud)
+{
+	if(strncmp(dev, "tcp://", 6)==0){
+		return new TcpTransport(dev+6);
+	}
+	if(strncmp(dev, "loopback://", 11)==0){
+		return new LoopbackTransport();
+	}
+	return new Serial(baud, dev, 80, 0);
+}
+
+int Transport::readFd(int fd, unsigned char* p, int len)
+{
+	int n;
+	do{
+		n=::read(fd, p, len);
+	}while(n<0 && errno==EINTR);
+
+	if(n<0 && (errno==EAGAIN || errno==EWOULDBLOCK)){
+		return 0;
+	}
+	return n;
+}
+
+int Transport::writeFd(int fd, const unsigned char* p, int len)
+{
+	int done=0;
+
+	while(done<len){
+		int n=::write(fd, p+done, len-done);
+		if(n>=0){
+			done+=n;
+			continue;
+		}
+		if(errno==EINTR){
+			continue;
+		}
+		if(errno!=EAGAIN && errno!=EWOULDBLOCK){
+			return -1;
+		}
+
+		struct pollfd pfd;
+		pfd.fd=fd;
+		pfd.events=POLLOUT;
+		pfd.revents=0;
+		if(poll(&pfd, 1, 1000)<=0){
+			return -1;
+		}
+	}
+	return done;
+}
@@ -0,0 +1,85 @@
+//---------------------------< /-/ AMSL /-/ >------------------------------
+/**
+ * file         :       roomba_capture_decode.cpp
+ *
+ *
+ * Environment  :       g++
+ *
+ */
+//-----------------------------------------------------------------------------
+
+// Offline decoder for captured ALL_PACKET replies.
+//   usage: roomba_capture_decode capture.bin output.col
+// The capture is the raw bytes read from the robot, 80 byte frames back to
+// back. A trailing partial frame is ignored.
+
+#include "roomba_500driver_meiji/bulk_decoder.h"
+#include "roomba_500driver_meiji/oi_packet.h"
+#include "roomba_500driver_meiji/timer.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+
+int main(int argc, char** argv) {
+
+	if(argc!=3){
+		fprintf(stderr, "usage: %s capture output\n", argv[0]);
+		return 1;
+	}
+
+	int fd=open(argv[1], O_RDONLY);
+	if(fd<0){
+		perror("roomba_capture_decode: Unable to open capture ");
+		return 1;
+	}
+
+	struct stat st;
+	if(fstat(fd, &st)<0){
+		perror("roomba_capture_decode: Unable to stat capture ");
+		close(fd);
+		return 1;
+	}
+
+	size_t frames=st.st_size/ALL_PACKET_SIZE;
+	if(frames==0){
+		fprintf(stderr, "roomba_capture_decode: no complete frame in %s\n", argv[1]);
+		close(fd);
+		return 1;
+	}
+
+	void* map=mmap(NULL, frames*ALL_PACKET_SIZE, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(map==MAP_FAILED){
+		perror("roomba_capture_decode: Unable to map capture ");
+		return 1;
+	}
+	madvise(map, frames*ALL_PACKET_SIZE, MADV_SEQUENTIAL);
+
+	double start=Timer::now();
+
+	BulkDecoder::Columns cols;
+	BulkDecoder::decode((const unsigned char*)map, frames, cols);
+	double decoded=Timer::now();
+
+	BulkDecoder::unwrapEncoders(cols);
+	BulkDecoder::integrateOdometry(cols);
+	double passes=Timer::now();
+
+	munmap(map, frames*ALL_PACKET_SIZE);
+
+	if(!BulkDecoder::write(cols, argv[2])){
+		return 1;
+	}
+	double written=Timer::now();
+
+	printf("frames      : %lu\n", (unsigned long)frames);
+	printf("decode      : %.3f sec, %.0f frames/sec\n", decoded-start, frames/(decoded-start));
+	printf("odometry    : %.3f sec, %.0f frames/sec\n", passes-decoded, frames/(passes-decoded));
+	printf("write       : %.3f sec\n", written-passes);
+	printf("total       : %.0f frames/sec\n", frames/(written-start));
+
+	return 0;
+}
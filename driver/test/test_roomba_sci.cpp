@@ -0,0 +1,215 @@
+//---------------------------< /-/ AMSL /-/ >------------------------------
+/**
+ * file         :       test_roomba_sci.cpp
+ *
+ *
+ * Environment  :       g++
+ *
+ */
+//-----------------------------------------------------------------------------
+
+// roombaSci against a LoopbackTransport, the Responder plays the robot.
+
+#include "roomba_500driver_meiji/roomba500sci.h"
+#include "roomba_500driver_meiji/loopback_transport.h"
+#include "roomba_500driver_meiji/oi_packet.h"
+
+#include <gtest/gtest.h>
+#include <string.h>
+
+using namespace roomba_500driver_meiji;
+
+// answers SENSORS with reply_size bytes of an ALL_PACKET frame,
+// or not at all when reply_size is 0
+class FakeRobot : public LoopbackTransport::Responder {
+public:
+	FakeRobot():mode(roombaSci::OI_OFF),reply_size(ALL_PACKET_SIZE),voltage(15000),
+		encoder_left(0),encoder_right(0){}
+
+	void received(LoopbackTransport& t, const unsigned char* p, int len){
+		for(int i=0; i<len; i++){
+			switch(p[i]){
+				case roombaSci::OC_START:	mode=roombaSci::OI_PASSIVE;	break;
+				case roombaSci::OC_CONTROL:
+				case roombaSci::OC_SAFE:	mode=roombaSci::OI_SAFE;	break;
+				case roombaSci::OC_FULL:	mode=roombaSci::OI_FULL;	break;
+				case roombaSci::OC_SENSORS:
+					if(i+1<len){
+						reply(t, p[++i]);
+					}
+					break;
+			}
+		}
+	}
+
+	void reply(LoopbackTransport& t, unsigned char packet){
+		if(packet==roombaSci::OI_MODE_PACKET){
+			unsigned char m=mode;
+			t.inject(&m, 1);
+			return;
+		}
+		if(packet!=roombaSci::ALL_PACKET || reply_size==0){
+			return;
+		}
+		unsigned char frame[ALL_PACKET_SIZE];
+		memset(frame, 0, sizeof(frame));
+		frame[OFS_VOLTAGE]=voltage>>8;
+		frame[OFS_VOLTAGE+1]=voltage&0xff;
+		frame[OFS_OI_MODE]=mode;
+		frame[OFS_ENCODER_LEFT]=encoder_left>>8;
+		frame[OFS_ENCODER_LEFT+1]=encoder_left&0xff;
+		frame[OFS_ENCODER_RIGHT]=encoder_right>>8;
+		frame[OFS_ENCODER_RIGHT+1]=encoder_right&0xff;
+		t.inject(frame, reply_size);
+	}
+
+	int mode;
+	int reply_size;
+	unsigned short voltage;
+	unsigned short encoder_left;
+	unsigned short encoder_right;
+};
+
+class RoombaSciTest : public ::testing::Test {
+protected:
+	RoombaSciTest(){
+		transport_=new LoopbackTransport(&robot_);
+		roomba_=new roombaSci(transport_);
+	}
+	~RoombaSciTest(){
+		delete roomba_;
+	}
+
+	FakeRobot robot_;
+	LoopbackTransport* transport_;	// owned by roomba_
+	roombaSci* roomba_;
+};
+
+TEST_F(RoombaSciTest, StartupReachesSafeMode)
+{
+	ASSERT_TRUE(roomba_->connected());
+	EXPECT_TRUE(roomba_->startup(0.5));
+	EXPECT_EQ(roombaSci::OI_SAFE, robot_.mode);
+	EXPECT_EQ(roombaSci::OI_SAFE, roomba_->mode());
+}
+
+TEST_F(RoombaSciTest, WritesAreRecordedOnlyWhenEnabled)
+{
+	ASSERT_TRUE(roomba_->startup(0.5));
+	EXPECT_TRUE(transport_->written().empty());
+
+	transport_->setRecording(true);
+	roomba_->driveDirect(0, 0);
+	ASSERT_EQ(5u, transport_->written().size());
+	EXPECT_EQ(roombaSci::OC_DRIVE_DIRECT, transport_->written()[0]);
+}
+
+TEST_F(RoombaSciTest, ValidFrameIsDecoded)
+{
+	ASSERT_TRUE(roomba_->startup(0.5));
+	Roomba500State sens;
+	EXPECT_GE(roomba_->getSensors(sens), 0);
+	EXPECT_TRUE(roomba_->validFrame());
+	EXPECT_EQ(15000, sens.voltage);
+	EXPECT_EQ(roombaSci::OI_SAFE, sens.open_interface_mode);
+}
+
+TEST_F(RoombaSciTest, ShortReplyIsNotAFrame)
+{
+	ASSERT_TRUE(roomba_->startup(0.5));
+	robot_.reply_size=40;
+	Roomba500State sens;
+	roomba_->getSensors(sens);
+	EXPECT_FALSE(roomba_->validFrame());
+	EXPECT_TRUE(roomba_->connected());
+
+	// the left-over bytes must not shift the next frame
+	robot_.reply_size=ALL_PACKET_SIZE;
+	robot_.voltage=14000;
+	roomba_->getSensors(sens);
+	EXPECT_TRUE(roomba_->validFrame());
+	EXPECT_EQ(14000, sens.voltage);
+}
+
+TEST_F(RoombaSciTest, MissedFramesLoseTheLinkAndReconnect)
+{
+	ASSERT_TRUE(roomba_->startup(0.5));
+	robot_.reply_size=0;
+	Roomba500State sens;
+	for(int i=0; i<MAX_MISSED_FRAMES-1; i++){
+		roomba_->getSensors(sens);
+		EXPECT_TRUE(roomba_->connected());
+	}
+	roomba_->getSensors(sens);
+	EXPECT_FALSE(roomba_->connected());
+	EXPECT_EQ(roombaSci::OI_UNKNOWN, roomba_->mode());
+
+	// the robot answers again, the first attempt is not delayed
+	robot_.reply_size=ALL_PACKET_SIZE;
+	EXPECT_TRUE(roomba_->reconnect());
+	EXPECT_TRUE(roomba_->connected());
+	roomba_->getSensors(sens);
+	EXPECT_TRUE(roomba_->validFrame());
+}
+
+// drops the link for the missed frames, the robot keeps its counts
+static void loseLink(roombaSci* roomba, FakeRobot& robot)
+{
+	Roomba500State sens;
+	robot.reply_size=0;
+	for(int i=0; i<MAX_MISSED_FRAMES; i++){
+		roomba->getSensors(sens);
+	}
+	robot.reply_size=ALL_PACKET_SIZE;
+}
+
+TEST_F(RoombaSciTest, MotionDuringOutageIsCounted)
+{
+	ASSERT_TRUE(roomba_->startup(0.5));
+	robot_.encoder_left=1000;
+	robot_.encoder_right=100;
+	Roomba500State sens;
+	roomba_->getSensors(sens);
+	ASSERT_TRUE(roomba_->validFrame());
+
+	loseLink(roomba_, robot_);
+	ASSERT_FALSE(roomba_->connected());
+	// the robot drove on for a few hundred ms
+	robot_.encoder_left=1300;
+	robot_.encoder_right=400;
+	ASSERT_TRUE(roomba_->reconnect());
+	roomba_->getSensors(sens);
+	ASSERT_TRUE(roomba_->validFrame());
+	EXPECT_TRUE(roomba_->encoderResynced());
+	EXPECT_EQ(300, roomba_->dEncoderLeft(ENCODER_RESYNC_MAX));
+	EXPECT_EQ(300, roomba_->dEncoderRight(ENCODER_RESYNC_MAX));
+
+	roomba_->getSensors(sens);
+	EXPECT_FALSE(roomba_->encoderResynced());
+}
+
+TEST_F(RoombaSciTest, ImplausibleCountsAfterOutageRestartTheBaseline)
+{
+	ASSERT_TRUE(roomba_->startup(0.5));
+	robot_.encoder_left=20000;
+	robot_.encoder_right=20000;
+	Roomba500State sens;
+	roomba_->getSensors(sens);
+
+	loseLink(roomba_, robot_);
+	// power cycled, the counts start over
+	robot_.encoder_left=0;
+	robot_.encoder_right=0;
+	ASSERT_TRUE(roomba_->reconnect());
+	roomba_->getSensors(sens);
+	ASSERT_TRUE(roomba_->validFrame());
+	EXPECT_FALSE(roomba_->encoderResynced());
+	EXPECT_EQ(0, roomba_->dEncoderLeft());
+	EXPECT_EQ(0, roomba_->dEncoderRight());
+}
+
+int main(int argc, char** argv)
+{
+	testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}